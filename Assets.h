@@ -0,0 +1,388 @@
+#pragma once
+// Asset loading for the Allegro front end.
+//
+// Two paths: decode the original PNG/BMP/WAV files on worker threads, or
+// map one packed file (written by --pack-assets) that already holds the
+// decoded RGBA pixels and PCM frames, so startup is a page-in and a few
+// memcpys. Both hand back memory bitmaps; the caller uploads them.
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "Atlas.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+struct SoundFile {
+    const char* path;
+    ALLEGRO_SAMPLE** slot;
+};
+
+
+// Drops a file from the OS page cache so the next read really goes to
+// disk, for cold-start measurements. Only Linux offers this without
+// privileges; elsewhere it does nothing and says so.
+inline bool evictFromCache(const char* path) {
+#if defined(__linux__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    fdatasync(fd);
+    bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+
+// Read-only memory map of a whole file.
+class MappedFile {
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const char* path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz;
+        GetFileSizeEx(file, &sz);
+        length = (size_t)sz.QuadPart;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) base = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            length = (size_t)st.st_size;
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) base = (const unsigned char*)p;
+        }
+        ::close(fd);
+#endif
+        if (!base) close();
+        return base != nullptr;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (base) UnmapViewOfFile(base);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base) munmap((void*)base, length);
+#endif
+        base = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+
+// Packed asset file layout, all little-endian:
+//   PackHeader, PackEntry[count], then each entry's payload at its offset
+//   (64-byte aligned). Images are tightly packed ABGR_8888_LE rows, the
+//   format Allegro locks premultiplied bitmaps in; sounds are the raw
+//   interleaved frames al_create_sample() takes.
+const char PACK_MAGIC[8] = { 'P', 'A', 'C', 'P', 'A', 'K', '1', 0 };
+enum PackEntryType { PACK_IMAGE = 1, PACK_SOUND = 2 };
+
+struct PackHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct PackEntry {
+    char name[96];          // the original asset path
+    uint32_t type;
+    uint32_t a, b, c, d;    // image: width, height; sound: frames, frequency, depth, channel conf
+    uint64_t offset, size;
+};
+
+
+class AssetPack {
+    MappedFile file;
+    const PackHeader* header = nullptr;
+    const PackEntry* entries = nullptr;
+
+    // The entry's payload lies inside the file and is exactly as big as
+    // its image or sound says, so nothing made from it reads past the map.
+    bool entryValid(const PackEntry& e) const {
+        if (memchr(e.name, 0, sizeof(e.name)) == nullptr) return false;
+        if (e.offset > file.size() || e.size > file.size() - e.offset) return false;
+        if (e.type == PACK_IMAGE) {
+            const uint32_t MAX_SIDE = 16384;
+            return e.a > 0 && e.b > 0 && e.a <= MAX_SIDE && e.b <= MAX_SIDE
+                && (uint64_t)e.a * e.b * 4 == e.size;
+        }
+        if (e.type == PACK_SOUND) {
+            size_t channels = al_get_channel_count((ALLEGRO_CHANNEL_CONF)e.d);
+            size_t depth = al_get_audio_depth_size((ALLEGRO_AUDIO_DEPTH)e.c);
+            return e.a > 0 && e.b > 0 && channels > 0 && depth > 0
+                && (uint64_t)e.a * channels * depth == e.size;
+        }
+        return false;
+    }
+
+    const PackEntry* find(const char* name, uint32_t type) const {
+        for (uint32_t i = 0; i < header->count; i++)
+            if (entries[i].type == type && strncmp(entries[i].name, name, sizeof(entries[i].name)) == 0)
+                return &entries[i];
+        return nullptr;
+    }
+
+public:
+    // Checks the header and every entry; a pack that fails is closed
+    // again, and the caller decodes the original files instead.
+    bool open(const char* path) {
+        if (!file.open(path)) return false;
+        header = (const PackHeader*)file.data();
+        if (file.size() < sizeof(PackHeader) || memcmp(header->magic, PACK_MAGIC, 8) != 0 ||
+            file.size() < sizeof(PackHeader) + (size_t)header->count * sizeof(PackEntry)) {
+            cerr << "ERROR: " << path << " is not an asset pack\n";
+            close();
+            return false;
+        }
+        entries = (const PackEntry*)(file.data() + sizeof(PackHeader));
+        for (uint32_t i = 0; i < header->count; i++)
+            if (!entryValid(entries[i])) {
+                cerr << "ERROR: " << path << " is damaged or out of date (entry " << i << ")\n";
+                close();
+                return false;
+            }
+        return true;
+    }
+
+    bool isOpen() const { return header != nullptr; }
+
+    // Must outlive every sample made by load(): they play straight from
+    // the mapping.
+    void close() {
+        file.close();
+        header = nullptr;
+        entries = nullptr;
+    }
+
+    ALLEGRO_BITMAP* makeBitmap(const char* name) const {
+        const PackEntry* e = find(name, PACK_IMAGE);
+        if (!e) return nullptr;
+        int oldFlags = al_get_new_bitmap_flags(), oldFormat = al_get_new_bitmap_format();
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+        al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+        ALLEGRO_BITMAP* b = al_create_bitmap(e->a, e->b);
+        al_set_new_bitmap_flags(oldFlags);
+        al_set_new_bitmap_format(oldFormat);
+        if (!b) return nullptr;
+
+        ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap(b, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+        if (!lr) {
+            al_destroy_bitmap(b);
+            return nullptr;
+        }
+        const unsigned char* src = file.data() + e->offset;
+        for (uint32_t y = 0; y < e->b; y++)
+            memcpy((unsigned char*)lr->data + (ptrdiff_t)y * lr->pitch, src + (size_t)y * e->a * 4, (size_t)e->a * 4);
+        al_unlock_bitmap(b);
+        return b;
+    }
+
+    ALLEGRO_SAMPLE* makeSample(const char* name) const {
+        const PackEntry* e = find(name, PACK_SOUND);
+        if (!e) return nullptr;
+        return al_create_sample((void*)(file.data() + e->offset), e->a, e->b,
+            (ALLEGRO_AUDIO_DEPTH)e->c, (ALLEGRO_CHANNEL_CONF)e->d, false);
+    }
+
+    // Everything or nothing: on failure `images` holds nulls and no sound
+    // slot is touched.
+    bool load(const vector<SpriteFile>& sprites, vector<ALLEGRO_BITMAP*>& images,
+        const vector<SoundFile>& sounds) const
+    {
+        images.assign(sprites.size(), nullptr);
+        vector<ALLEGRO_SAMPLE*> samples(sounds.size(), nullptr);
+        bool ok = true;
+        for (size_t i = 0; i < sprites.size() && ok; i++)
+            if (!(images[i] = makeBitmap(sprites[i].path))) {
+                cerr << "ERROR: asset pack has no image " << sprites[i].path << "\n";
+                ok = false;
+            }
+        for (size_t i = 0; i < sounds.size() && ok; i++)
+            if (!(samples[i] = makeSample(sounds[i].path))) {
+                cerr << "ERROR: asset pack has no sound " << sounds[i].path << "\n";
+                ok = false;
+            }
+        if (!ok) {
+            for (auto& b : images) { al_destroy_bitmap(b); b = nullptr; }
+            for (auto s : samples) al_destroy_sample(s);
+            return false;
+        }
+        for (size_t i = 0; i < sounds.size(); i++) *sounds[i].slot = samples[i];
+        return true;
+    }
+};
+
+
+// Decodes the original files on up to `threads` workers while the caller
+// gets on with other work; join() waits and reports. Memory bitmaps only,
+// so no worker ever touches the display.
+class ParallelLoader {
+    const vector<SpriteFile>* sprites = nullptr;
+    const vector<SoundFile>* sounds = nullptr;
+    vector<ALLEGRO_BITMAP*>* images = nullptr;
+    vector<ALLEGRO_SAMPLE*> samples;
+    atomic<size_t> nextTask{ 0 };
+    vector<thread> workers;
+
+    void work() {
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);     // per-thread setting
+        size_t total = sprites->size() + sounds->size();
+        for (size_t t; (t = nextTask++) < total;) {
+            if (t < sprites->size()) (*images)[t] = al_load_bitmap((*sprites)[t].path);
+            else samples[t - sprites->size()] = al_load_sample((*sounds)[t - sprites->size()].path);
+        }
+    }
+
+public:
+    void start(const vector<SpriteFile>& sp, vector<ALLEGRO_BITMAP*>& out,
+        const vector<SoundFile>& so, int threads)
+    {
+        sprites = &sp;
+        sounds = &so;
+        images = &out;
+        images->assign(sp.size(), nullptr);
+        samples.assign(so.size(), nullptr);
+        nextTask = 0;
+        int n = (int)min(sp.size() + so.size(), (size_t)(threads > 0 ? threads : 1));
+        for (int i = 0; i < n; i++) workers.emplace_back(&ParallelLoader::work, this);
+    }
+
+    // Same contract as AssetPack::load().
+    bool join() {
+        for (auto& w : workers) w.join();
+        workers.clear();
+
+        bool ok = true;
+        for (size_t i = 0; i < images->size(); i++)
+            if (!(*images)[i]) {
+                cerr << "ERROR: failed to load bitmap: " << (*sprites)[i].path << "\n";
+                ok = false;
+            }
+        for (size_t i = 0; i < samples.size(); i++)
+            if (!samples[i]) {
+                cerr << "Failed to load " << (*sounds)[i].path << "\n";
+                ok = false;
+            }
+        if (!ok) {
+            for (auto& b : *images) { al_destroy_bitmap(b); b = nullptr; }
+            for (auto s : samples) al_destroy_sample(s);
+            return false;
+        }
+        for (size_t i = 0; i < samples.size(); i++) *(*sounds)[i].slot = samples[i];
+        return true;
+    }
+};
+
+
+// Decodes every asset and writes them into one pack at `path`.
+inline bool writeAssetPack(const char* path, const vector<SpriteFile>& sprites,
+    const vector<SoundFile>& sounds)
+{
+    vector<ALLEGRO_BITMAP*> images;
+    ParallelLoader loader;
+    loader.start(sprites, images, sounds, (int)thread::hardware_concurrency());
+    if (!loader.join()) return false;
+
+    vector<PackEntry> entries(sprites.size() + sounds.size());
+    vector<vector<unsigned char>> payloads(entries.size());
+    for (size_t i = 0; i < sprites.size(); i++) {
+        PackEntry& e = entries[i];
+        memset(&e, 0, sizeof(e));
+        snprintf(e.name, sizeof(e.name), "%s", sprites[i].path);
+        e.type = PACK_IMAGE;
+        e.a = al_get_bitmap_width(images[i]);
+        e.b = al_get_bitmap_height(images[i]);
+        payloads[i].resize((size_t)e.a * e.b * 4);
+        ALLEGRO_LOCKED_REGION* lr = al_lock_bitmap(images[i], ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY);
+        for (uint32_t y = 0; y < e.b; y++)
+            memcpy(&payloads[i][(size_t)y * e.a * 4], (unsigned char*)lr->data + (ptrdiff_t)y * lr->pitch, (size_t)e.a * 4);
+        al_unlock_bitmap(images[i]);
+        al_destroy_bitmap(images[i]);
+    }
+    for (size_t i = 0; i < sounds.size(); i++) {
+        ALLEGRO_SAMPLE* s = *sounds[i].slot;
+        PackEntry& e = entries[sprites.size() + i];
+        memset(&e, 0, sizeof(e));
+        snprintf(e.name, sizeof(e.name), "%s", sounds[i].path);
+        e.type = PACK_SOUND;
+        e.a = al_get_sample_length(s);
+        e.b = al_get_sample_frequency(s);
+        e.c = al_get_sample_depth(s);
+        e.d = al_get_sample_channels(s);
+        size_t bytes = (size_t)e.a * al_get_channel_count(al_get_sample_channels(s))
+            * al_get_audio_depth_size(al_get_sample_depth(s));
+        const unsigned char* pcm = (const unsigned char*)al_get_sample_data(s);
+        payloads[sprites.size() + i].assign(pcm, pcm + bytes);
+        al_destroy_sample(s);
+        *sounds[i].slot = nullptr;
+    }
+
+    uint64_t offset = sizeof(PackHeader) + entries.size() * sizeof(PackEntry);
+    for (size_t i = 0; i < entries.size(); i++) {
+        offset = (offset + 63) & ~(uint64_t)63;
+        entries[i].offset = offset;
+        entries[i].size = payloads[i].size();
+        offset += payloads[i].size();
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f) { cerr << "ERROR: cannot write " << path << "\n"; return false; }
+    PackHeader h;
+    memcpy(h.magic, PACK_MAGIC, 8);
+    h.count = (uint32_t)entries.size();
+    h.reserved = 0;
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(entries.data(), sizeof(PackEntry), entries.size(), f);
+    static const unsigned char zeros[64] = {};
+    for (size_t i = 0; i < entries.size(); i++) {
+        long pad = (long)(entries[i].offset - (uint64_t)ftell(f));
+        fwrite(zeros, 1, (size_t)pad, f);
+        fwrite(payloads[i].data(), 1, payloads[i].size(), f);
+    }
+    bool ok = ferror(f) == 0;
+    fclose(f);
+    printf("wrote %s: %zu assets, %llu bytes\n", path, entries.size(), (unsigned long long)offset);
+    return ok;
+}
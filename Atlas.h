@@ -0,0 +1,101 @@
+#pragma once
+// Sprite atlas and draw-call accounting for the Allegro front end.
+//
+// All sprites are decoded into memory bitmaps (see Assets.h), shelf-packed into one
+// video texture and handed back as sub-bitmaps, so every sprite shares a
+// texture and a run of draws inside al_hold_bitmap_drawing() goes to the
+// GPU as one batch.
+#include <allegro5/allegro.h>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+struct SpriteFile {
+    const char* path;
+    ALLEGRO_BITMAP** slot;
+};
+
+
+class SpriteAtlas {
+    static const int WIDTH = 1024;
+    static const int PAD = 1;       // keeps filtering from bleeding across sprites
+    ALLEGRO_BITMAP* atlas = nullptr;
+
+public:
+    ALLEGRO_BITMAP* texture() const { return atlas; }
+
+    // Fills every slot with a sub-bitmap of the atlas, packing decoded[i]
+    // for files[i]. The decoded bitmaps are consumed either way. On failure
+    // nothing is left allocated and the slots are untouched.
+    bool build(const vector<SpriteFile>& files, const vector<ALLEGRO_BITMAP*>& decoded) {
+        // Shelf packing in file order: left to right, a new shelf when the
+        // row is full.
+        vector<int> xs(files.size()), ys(files.size());
+        int x = 0, y = 0, shelf = 0;
+        for (size_t i = 0; i < decoded.size(); i++) {
+            int w = al_get_bitmap_width(decoded[i]), h = al_get_bitmap_height(decoded[i]);
+            if (x + w > WIDTH) { x = 0; y += shelf + PAD; shelf = 0; }
+            xs[i] = x; ys[i] = y;
+            x += w + PAD;
+            if (h > shelf) shelf = h;
+        }
+
+        atlas = al_create_bitmap(WIDTH, y + shelf);
+        if (!atlas) {
+            cerr << "ERROR: failed to create sprite atlas\n";
+            for (auto d : decoded) al_destroy_bitmap(d);
+            return false;
+        }
+
+        ALLEGRO_BITMAP* oldTarget = al_get_target_bitmap();
+        al_set_target_bitmap(atlas);
+        al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);     // copy alpha as is
+        for (size_t i = 0; i < decoded.size(); i++)
+            al_draw_bitmap(decoded[i], xs[i], ys[i], 0);
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+        al_set_target_bitmap(oldTarget);
+
+        for (size_t i = 0; i < decoded.size(); i++) {
+            *files[i].slot = al_create_sub_bitmap(atlas, xs[i], ys[i],
+                al_get_bitmap_width(decoded[i]), al_get_bitmap_height(decoded[i]));
+            al_destroy_bitmap(decoded[i]);
+        }
+        return true;
+    }
+
+    // Sub-bitmaps must be destroyed before this.
+    void destroy() {
+        al_destroy_bitmap(atlas);
+        atlas = nullptr;
+    }
+};
+
+
+// What a frame asks of the GPU. A bind is a change of source texture; a
+// submission is one batch sent to the driver: every draw when drawing is
+// not held, one per run of same-texture draws when it is.
+struct DrawStats {
+    long long calls = 0, binds = 0, submits = 0;
+    ALLEGRO_BITMAP* bound = nullptr;
+    bool held = false, batchOpen = false;
+
+    void count(ALLEGRO_BITMAP* b) {
+        ALLEGRO_BITMAP* tex = al_get_parent_bitmap(b) ? al_get_parent_bitmap(b) : b;
+        calls++;
+        bool changed = tex != bound;
+        if (changed) binds++;
+        bound = tex;
+        if (!held) submits++;
+        else if (changed || !batchOpen) { submits++; batchOpen = true; }
+    }
+
+    void hold(bool on) {
+        held = on;
+        batchOpen = false;
+    }
+
+    void clear() { calls = binds = submits = 0; }
+};
@@ -0,0 +1,266 @@
+#pragma once
+// A search-based player: picks Pacman's next input by looking a few ticks
+// ahead in a private copy of the game.
+//
+// The search is expectimax. At each ply Pacman tries every direction that
+// moves him, plus one blocked direction to stand still. The ghosts' dice
+// are the chance layer: each action is stepped under a few generator
+// states derived from the position (the same ones for every action, so
+// actions are compared on the same luck), and their outcomes averaged. The
+// real generator state is never used, so the player cannot see the future.
+//
+// Depth grows one ply at a time until a fixed budget of simulated ticks
+// runs out. The budget counts ticks, not time, so a decision depends only
+// on the game and never on how fast the machine is. Positions reached
+// twice, in one search or across decisions, are found in a transposition
+// table keyed by Simulation::hashAhead(MAX_DEPTH), which tells apart
+// positions whose ghosts head different ways or leave the house at
+// different times within the search.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "PathTable.h"
+#include "Sim.h"
+
+using namespace std;
+
+
+class AutoPlayer {
+public:
+    static const int MAX_DEPTH = 16;
+    static const int DEFAULT_BUDGET = 20000;    // simulated ticks per decision
+    static const int TABLE_BITS = 18;
+    static_assert(MAX_DEPTH < ZobristKeys::RELEASE_TICKS, "hashAhead() must see the whole search");
+
+    struct Stats {
+        uint64_t decisions = 0;
+        uint64_t nodes = 0;         // simulated ticks
+        uint64_t lookups = 0, hits = 0;
+        uint64_t depthSum = 0;      // deepest completed search per decision
+        double seconds = 0, maxMs = 0;
+    };
+
+private:
+    // Outcomes, against a leaf worth about 100 per point of score.
+    static constexpr double LOSS = -100000, WIN = 100000, LIFE_LOST = -20000;
+    static constexpr double EXTRA_LIFE = 3000;
+    static constexpr double DOT_DIST = 2;       // per cell to the nearest dot or key
+    static constexpr double GHOST_NEAR = 4000;  // a ghost on Pacman's cell; quartered per cell away
+    static constexpr double GAMMA = 0.99;       // sooner is better, for gains and losses alike
+    static const int GHOST_RADIUS = 6;
+    static const int BFS_CELLS = 128;
+    static const int CHANCE_SAMPLES = 2;
+
+    struct Entry {
+        uint64_t key = 0;
+        double value = 0;
+        int depth = -1;             // plies searched below the position, -1 if empty
+    };
+
+    int budget;
+    Simulation sim;                 // scratch: whichever position is being looked at
+    SimSnapshot plies[MAX_DEPTH + 1];
+    vector<Entry> table;            // replace-always, made on the first decision
+    uint64_t nodes = 0;             // this decision
+    bool outOfBudget = false;
+    Stats stats;
+
+    // Leaf evaluation walks the maze from Pacman, over PathTable ids.
+    const PathTable* paths = nullptr;
+    vector<short> neighbours;       // [id * 4 + dir - 1], -1 for walls
+    vector<short> cellOfId;         // cellIndex() of each id
+    vector<unsigned> seen;          // == stamp: dist holds this walk's distance
+    vector<short> dist, queue;
+    unsigned stamp = 0;
+
+    void prepare(const PathTable& p) {
+        if (paths == &p) return;
+        paths = &p;
+        int n = p.cellCount();
+        neighbours.assign((size_t)n * 4, -1);
+        cellOfId.resize(n);
+        for (int id = 0; id < n; id++) {
+            cellOfId[id] = (short)cellIndex(p.cellRow(id), p.cellCol(id));
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                int x = p.cellRow(id), y = p.cellCol(id);
+                PathTable::applyDir(x, y, d);
+                neighbours[id * 4 + d - 1] = (short)p.idOf(x, y);
+            }
+        }
+        seen.assign(n, 0);
+        dist.resize(n);
+        queue.resize(n);
+        stamp = 0;
+    }
+
+    // A generator state for chance sample `j` at a position whose own
+    // state is `base`. SplitMix64, never zero.
+    static uint64_t sampleState(uint64_t base, int j) {
+        uint64_t z = base + (uint64_t)(j + 1) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return z ? z : 1;
+    }
+
+    // Inputs worth trying from `s`: each direction that moves Pacman, then
+    // one that does not, if any, for standing still.
+    static int actionsOf(const SimSnapshot& s, int* out) {
+        int n = 0, stay = DIR_NONE;
+        for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+            int x = s.pac.gridX, y = s.pac.gridY;
+            if (Pacman::moveRule(s.map, x, y, d) != DIR_NONE) out[n++] = d;
+            else if (stay == DIR_NONE) stay = d;
+        }
+        if (stay != DIR_NONE) out[n++] = stay;
+        return n;
+    }
+
+    // Score, the extra life, how far the nearest dot is and how close the
+    // released ghosts are, by maze distance.
+    double evaluate(const Simulation& g) {
+        double v = 100.0 * g.getScore() + (g.hasExtraLifeAvailable() ? EXTRA_LIFE : 0);
+        const Pacman& pac = g.getPacman();
+        int from = paths->idOf(pac.getGridX(), pac.getGridY());
+        if (from < 0) return v;
+
+        if (++stamp == 0) {
+            fill(seen.begin(), seen.end(), 0u);
+            stamp = 1;
+        }
+        const uint64_t* dots = g.getMap().dotBits();
+        const uint64_t* keys = g.getMap().keyBits();
+        int head = 0, tail = 0, dotDist = -1;
+        seen[from] = stamp;
+        dist[from] = 0;
+        queue[tail++] = (short)from;
+        while (head < tail) {
+            int c = queue[head++];
+            if (dotDist < 0 && (testBit(dots, cellOfId[c]) || testBit(keys, cellOfId[c])))
+                dotDist = dist[c];
+            if (dotDist >= 0 && dist[c] >= GHOST_RADIUS) break;
+            if (tail >= BFS_CELLS) continue;
+            for (int d = 0; d < 4; d++) {
+                int nb = neighbours[c * 4 + d];
+                if (nb < 0 || seen[nb] == stamp) continue;
+                seen[nb] = stamp;
+                dist[nb] = (short)(dist[c] + 1);
+                queue[tail++] = (short)nb;
+            }
+        }
+        v -= DOT_DIST * (dotDist >= 0 ? dotDist : BFS_CELLS);
+
+        const GhostSet& ghosts = g.getGhosts();
+        for (int i = 0; i < ghosts.size(); i++) {
+            GhostView gv = ghosts.get(i);
+            if (!gv.isReleased()) continue;
+            int id = paths->idOf(gv.getGridX(), gv.getGridY());
+            if (id >= 0 && seen[id] == stamp && dist[id] <= GHOST_RADIUS)
+                v -= GHOST_NEAR / (double)(1 << (2 * dist[id]));
+        }
+        return v;
+    }
+
+    // Value of plies[p], which `sim` holds on entry, searched `depth` more plies.
+    double value(int p, int depth) {
+        uint64_t key = sim.hashAhead(MAX_DEPTH);
+        Entry& e = table[key & (table.size() - 1)];
+        stats.lookups++;
+        if (e.key == key && e.depth >= depth) {
+            stats.hits++;
+            return e.value;
+        }
+        double v = expand(p, depth, nullptr);
+        if (!outOfBudget) {
+            e.key = key;
+            e.value = v;
+            e.depth = depth;
+        }
+        return v;
+    }
+
+    // Best action value at plies[p]; sets outOfBudget, and returns early,
+    // if the budget runs out on the way.
+    double expand(int p, int depth, int* bestAction) {
+        const SimSnapshot& s = plies[p];
+        int acts[5];
+        int n = actionsOf(s, acts);
+        int samples = sim.getGhosts().liveOf(GHOST_RANDOM) > 0 ? CHANCE_SAMPLES : 1;
+        uint64_t luck[CHANCE_SAMPLES];
+        for (int j = 0; j < samples; j++) luck[j] = sampleState(s.rngState, j);
+
+        double best = LOSS * 2;
+        for (int a = 0; a < n; a++) {
+            double sum = 0;
+            for (int j = 0; j < samples; j++) {
+                if (nodes >= (uint64_t)budget) {
+                    outOfBudget = true;
+                    return best;
+                }
+                SimSnapshot& child = plies[p + 1];
+                child = s;
+                child.rngState = luck[j];
+                sim.restore(child);
+                TickResult r = sim.step(acts[a]);
+                nodes++;
+                double q;
+                if (r.gameOver) q = LOSS;
+                else if (r.won) q = WIN;
+                else {
+                    if (depth > 1) sim.save(child);
+                    q = GAMMA * (depth > 1 ? value(p + 1, depth - 1) : evaluate(sim));
+                    if (r.lostLife) q += LIFE_LOST;
+                }
+                sum += q;
+            }
+            double v = sum / samples;
+            if (v > best) {
+                best = v;
+                if (bestAction) *bestAction = acts[a];
+            }
+        }
+        return best;
+    }
+
+public:
+    explicit AutoPlayer(int nodeBudget = DEFAULT_BUDGET) : budget(nodeBudget) {}
+    AutoPlayer(const AutoPlayer&) = delete;
+    AutoPlayer& operator=(const AutoPlayer&) = delete;
+
+    // The input to give `game` for its next tick; DIR_NONE once it is over.
+    int choose(const Simulation& game) {
+        if (game.isFinished()) return DIR_NONE;
+        auto t0 = chrono::steady_clock::now();
+        if (table.empty()) table.resize((size_t)1 << TABLE_BITS);
+        prepare(game.getPaths());
+
+        game.save(plies[0]);
+        nodes = 0;
+        int move = DIR_NONE, reached = 0;
+        for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+            int a = DIR_NONE;
+            outOfBudget = false;
+            sim.restore(plies[0]);
+            expand(0, depth, &a);
+            if (outOfBudget) break;
+            move = a;
+            reached = depth;
+        }
+        if (move == DIR_NONE) {
+            int acts[5];
+            move = actionsOf(plies[0], acts) > 0 ? acts[0] : DIR_NONE;
+        }
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        stats.decisions++;
+        stats.nodes += nodes;
+        stats.depthSum += reached;
+        stats.seconds += ms / 1000;
+        if (ms > stats.maxMs) stats.maxMs = ms;
+        return move;
+    }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+};
@@ -0,0 +1,193 @@
+#pragma once
+// Batch mode: runs many complete games (level 1 until a win, a game over or
+// a frame cap) across all cores. Game lengths vary from a few dozen frames
+// to tens of thousands, so work is handed out through per-worker ranges
+// that idle workers steal from instead of a fixed split.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "Sim.h"
+
+using namespace std;
+
+
+// Picks the input for the next tick. Must only touch its own arguments so
+// games can run on any thread.
+typedef int (*InputPolicy)(const Simulation& sim, Rng& rng);
+
+// Default load: Pacman keeps a random intent for 8 ticks at a time.
+inline int wanderPolicy(const Simulation& sim, Rng& rng) {
+    if (sim.getFrameCount() % 8 == 0) return (int)rng.below(4) + 1;
+    return DIR_NONE;
+}
+
+
+// Greedy eater: walks the shortest path to the closest remaining dot or
+// key (closest in straight-line cells, which is cheap and good enough to
+// clear levels), ignoring ghosts.
+inline int dotPolicy(const Simulation& sim, Rng&) {
+    const Map& map = sim.getMap();
+    const Pacman& p = sim.getPacman();
+    int bestX = -1, bestY = -1, best = 1 << 30;
+    for (int i = 0; i < MAP_ROWS; i++)
+        for (int j = 0; j < MAP_COLS; j++) {
+            char c = map.get(i, j);
+            if (c != DOT && c != KEY) continue;
+            int d = abs(i - p.getGridX()) + abs(j - p.getGridY());
+            if (d < best) { best = d; bestX = i; bestY = j; }
+        }
+    if (bestX < 0) return DIR_NONE;
+    return sim.getPaths().nextDir(p.getGridX(), p.getGridY(), bestX, bestY);
+}
+
+
+enum GameEnd { END_CAUGHT, END_WON, END_TIMEOUT };
+
+struct GameResult {
+    uint64_t seed = 0;
+    int score = 0;
+    int level = 0;
+    int frames = 0;
+    int end = END_TIMEOUT;
+    int killer = -1;        // GhostKind for END_CAUGHT
+};
+
+
+inline const char* gameEndName(int end) {
+    switch (end) {
+    case END_CAUGHT: return "caught";
+    case END_WON:    return "won";
+    default:         return "timeout";
+    }
+}
+
+inline const char* ghostKindName(int kind) {
+    switch (kind) {
+    case GHOST_RANDOM: return "random";
+    case GHOST_BLINKY: return "blinky";
+    case GHOST_PINKY:  return "pinky";
+    default:           return "-";
+    }
+}
+
+
+// Plays one game to the end on the calling thread. The simulation is
+// reset rather than built, so a worker plays every game in one instance.
+inline GameResult playGame(Simulation& sim, uint64_t seed, InputPolicy policy, int maxFrames) {
+    sim.reset(seed);
+    Rng inputRng(~seed);
+    while (!sim.isFinished() && sim.getFrameCount() < maxFrames)
+        sim.step(policy(sim, inputRng));
+
+    GameResult r;
+    r.seed = seed;
+    r.score = sim.getScore();
+    r.level = sim.getLevel();
+    r.frames = sim.getFrameCount();
+    if (sim.isWon()) r.end = END_WON;
+    else if (sim.isGameOver()) { r.end = END_CAUGHT; r.killer = sim.getCaughtBy(); }
+    else r.end = END_TIMEOUT;
+    return r;
+}
+
+
+class BatchRunner {
+    // Each worker owns a range of game indices packed as (begin << 32 | end).
+    // The owner takes from the front one game at a time; a thief takes the
+    // back half of the fullest range it can find. Both sides only ever CAS.
+    struct alignas(64) Range {
+        atomic<uint64_t> r{ 0 };
+    };
+
+    static uint64_t pack(uint32_t b, uint32_t e) { return ((uint64_t)b << 32) | e; }
+    static uint32_t first(uint64_t v) { return (uint32_t)(v >> 32); }
+    static uint32_t last(uint64_t v) { return (uint32_t)v; }
+
+    int threads;
+    vector<Range> ranges;
+    atomic<long long> steals{ 0 };
+    bool profiled = false;
+
+    bool takeOwn(int self, uint32_t& idx) {
+        uint64_t v = ranges[self].r.load(memory_order_acquire);
+        while (first(v) < last(v)) {
+            if (ranges[self].r.compare_exchange_weak(v, pack(first(v) + 1, last(v)),
+                memory_order_acq_rel)) {
+                idx = first(v);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool steal(int self) {
+        for (;;) {
+            int victim = -1;
+            uint32_t most = 0;
+            uint64_t seen = 0;
+            for (int i = 0; i < threads; i++) {
+                if (i == self) continue;
+                uint64_t v = ranges[i].r.load(memory_order_acquire);
+                if (first(v) < last(v) && last(v) - first(v) > most) {
+                    most = last(v) - first(v);
+                    victim = i;
+                    seen = v;
+                }
+            }
+            if (victim < 0) return false;
+
+            uint32_t b = first(seen), e = last(seen);
+            uint32_t mid = b + (e - b) / 2;     // a single game goes whole
+            if (ranges[victim].r.compare_exchange_strong(seen, pack(b, mid),
+                memory_order_acq_rel)) {
+                ranges[self].r.store(pack(mid, e), memory_order_release);
+                steals++;
+                return true;
+            }
+        }
+    }
+
+public:
+    explicit BatchRunner(int threadCount)
+        : threads(threadCount > 0 ? threadCount : 1), ranges(threads) {
+    }
+
+    long long getSteals() const { return steals.load(); }
+
+    // Times every worker's Simulation::step() phases under --profile.
+    void setProfiled(bool on) { profiled = on; }
+
+    // Plays `games` games seeded baseSeed, baseSeed + 1, ... and returns
+    // their results in seed order.
+    vector<GameResult> run(int games, uint64_t baseSeed,
+        InputPolicy policy = wanderPolicy, int maxFrames = 100000)
+    {
+        vector<GameResult> results(games);
+        steals = 0;
+        for (int t = 0; t < threads; t++) {
+            uint32_t b = (uint32_t)((long long)games * t / threads);
+            uint32_t e = (uint32_t)((long long)games * (t + 1) / threads);
+            ranges[t].r.store(pack(b, e));
+        }
+
+        auto worker = [&](int self) {
+            Simulation sim;
+            sim.setProfiled(profiled);
+            uint32_t idx;
+            for (;;) {
+                if (takeOwn(self, idx))
+                    results[idx] = playGame(sim, baseSeed + idx, policy, maxFrames);
+                else if (!steal(self))
+                    break;
+            }
+            };
+
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+        worker(0);
+        for (auto& th : pool) th.join();
+        return results;
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+// Mazes far larger than the classic board, up to thousands of cells on a
+// side, generated from a seed and stored in CHUNK_SIZE x CHUNK_SIZE chunks.
+//
+// A chunk is made the first time something asks for it and never before,
+// so memory follows the part of the maze that has been visited rather
+// than its size. Each chunk is built from its own seed, without looking at
+// its neighbours, so chunks can be made in any order and still fit:
+//
+//   - cells with an odd row and an odd column are rooms; a randomised
+//     depth-first search joins every room of the chunk into a tree, and a
+//     few extra walls come down so there are loops to run around;
+//   - a chunk owns its top row and left column, and opens DOORS of them
+//     onto the rooms of the chunk above and the chunk to the left. Every
+//     chunk reaches all of its rooms and its neighbours, so the whole maze
+//     is one connected piece.
+//
+// Every open cell starts with a dot. There are no tunnels; off the board
+// is wall.
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Map.h"
+#include "Rng.h"
+
+using namespace std;
+
+
+const int CHUNK_SHIFT = 5;
+const int CHUNK_SIZE = 1 << CHUNK_SHIFT;                // cells per side
+const int CHUNK_WORDS = CHUNK_SIZE * CHUNK_SIZE / 64;
+
+struct MazeChunk {
+    uint64_t walls[CHUNK_WORDS];    // bit (row * CHUNK_SIZE + col), local to the chunk
+    uint64_t dots[CHUNK_WORDS];
+    int dotCount = 0;
+    vector<int> ghosts;             // BigWorld ghosts standing in the chunk
+
+    // The CHUNK_SIZE bits of local row `r` of a layer.
+    static uint32_t rowBits(const uint64_t* layer, int r) {
+        return (uint32_t)(layer[r >> 1] >> ((r & 1) * CHUNK_SIZE));
+    }
+};
+
+
+class BigMaze {
+    static const int ROOMS = CHUNK_SIZE / 2;    // per side of a chunk
+    static const int DOORS = 3;                 // per shared edge
+    static const int BRAID = 8;                 // one wall in BRAID between rooms comes down
+
+    int rows, cols, chunkRows, chunkCols;
+    uint64_t seed;
+    vector<unique_ptr<MazeChunk>> chunks;       // row-major; null until made
+    int made = 0;
+
+    static int local(int x, int y) { return (x & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (y & (CHUNK_SIZE - 1)); }
+
+    void generate(MazeChunk& c, int cx, int cy) const {
+        memset(c.walls, 0xFF, sizeof(c.walls));
+        Rng rng(chunkSeed(cx, cy));
+        auto open = [&](int r, int col) { clearBit(c.walls, r * CHUNK_SIZE + col); };
+
+        // Depth-first search over the rooms, with an explicit stack.
+        bool seen[ROOMS * ROOMS] = {};
+        short stack[ROOMS * ROOMS];
+        int top = 0;
+        int start = (int)rng.below(ROOMS * ROOMS);
+        seen[start] = true;
+        stack[top++] = (short)start;
+        open(start / ROOMS * 2 + 1, start % ROOMS * 2 + 1);
+        while (top > 0) {
+            int room = stack[top - 1], ri = room / ROOMS, rj = room % ROOMS;
+            int next[4], n = 0;
+            if (ri > 0 && !seen[room - ROOMS]) next[n++] = room - ROOMS;
+            if (ri < ROOMS - 1 && !seen[room + ROOMS]) next[n++] = room + ROOMS;
+            if (rj > 0 && !seen[room - 1]) next[n++] = room - 1;
+            if (rj < ROOMS - 1 && !seen[room + 1]) next[n++] = room + 1;
+            if (n == 0) {
+                top--;
+                continue;
+            }
+            int to = next[rng.below(n)];
+            seen[to] = true;
+            stack[top++] = (short)to;
+            int ti = to / ROOMS, tj = to % ROOMS;
+            open(ti * 2 + 1, tj * 2 + 1);
+            open(ri + ti + 1, rj + tj + 1);     // the wall between the two rooms
+        }
+
+        // Braiding: walls between two rooms, not on the chunk's own edges.
+        for (int r = 1; r < CHUNK_SIZE - 1; r++)
+            for (int col = 1 + (r & 1); col < CHUNK_SIZE - 1; col += 2)
+                if (rng.below(BRAID) == 0) open(r, col);
+
+        for (int k = 0; k < DOORS; k++) {
+            if (cy > 0) open((int)rng.below(ROOMS) * 2 + 1, 0);
+            if (cx > 0) open(0, (int)rng.below(ROOMS) * 2 + 1);
+        }
+
+        c.dotCount = 0;
+        for (int w = 0; w < CHUNK_WORDS; w++) {
+            c.dots[w] = ~c.walls[w];
+            c.dotCount += popcount64(c.dots[w]);
+        }
+    }
+
+public:
+    // `size` cells per side, rounded up to whole chunks.
+    BigMaze(int size, uint64_t seed) : seed(seed) {
+        chunkRows = chunkCols = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        if (chunkRows < 1) chunkRows = chunkCols = 1;
+        rows = chunkRows * CHUNK_SIZE;
+        cols = chunkCols * CHUNK_SIZE;
+        chunks.resize((size_t)chunkRows * chunkCols);
+    }
+
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+    int getChunkRows() const { return chunkRows; }
+    int getChunkCols() const { return chunkCols; }
+    int madeChunks() const { return made; }
+
+    uint64_t chunkSeed(int cx, int cy) const {
+        return seed ^ ((uint64_t)(uint32_t)cx << 32 | (uint32_t)cy) * 0x9E3779B97F4A7C15ull;
+    }
+
+    static int chunkOf(int cell) { return cell >> CHUNK_SHIFT; }
+
+    // The chunk, or nullptr if it is off the board or not made yet.
+    MazeChunk* chunk(int cx, int cy) const {
+        if ((unsigned)cx >= (unsigned)chunkRows || (unsigned)cy >= (unsigned)chunkCols) return nullptr;
+        return chunks[(size_t)cx * chunkCols + cy].get();
+    }
+
+    // Makes the chunk if it does not exist yet; false if it is off the board.
+    bool ensure(int cx, int cy) {
+        if ((unsigned)cx >= (unsigned)chunkRows || (unsigned)cy >= (unsigned)chunkCols) return false;
+        unique_ptr<MazeChunk>& c = chunks[(size_t)cx * chunkCols + cy];
+        if (!c) {
+            c.reset(new MazeChunk());
+            generate(*c, cx, cy);
+            made++;
+        }
+        return true;
+    }
+
+    // Cells of chunks not made yet read as wall, so nothing walks into them.
+    bool isWall(int x, int y) const {
+        const MazeChunk* c = chunk(chunkOf(x), chunkOf(y));
+        return !c || testBit(c->walls, local(x, y));
+    }
+
+    bool hasDot(int x, int y) const {
+        const MazeChunk* c = chunk(chunkOf(x), chunkOf(y));
+        return c && testBit(c->dots, local(x, y));
+    }
+
+    // Takes the dot off (x, y); false if there was none.
+    bool eatDot(int x, int y) {
+        MazeChunk* c = chunk(chunkOf(x), chunkOf(y));
+        if (!c || !testBit(c->dots, local(x, y))) return false;
+        clearBit(c->dots, local(x, y));
+        c->dotCount--;
+        return true;
+    }
+
+    size_t bytes() const {
+        size_t n = sizeof(*this) + chunks.capacity() * sizeof(chunks[0]);
+        for (const auto& c : chunks)
+            if (c) n += sizeof(MazeChunk) + c->ghosts.capacity() * sizeof(int);
+        return n;
+    }
+};
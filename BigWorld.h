@@ -0,0 +1,263 @@
+#pragma once
+// A game on a BigMaze: Pacman, a few ghosts per chunk and a camera that
+// follows him. Only the chunks within ACTIVE_RADIUS of his are made and
+// simulated, and only the chunks under the camera are looked at for
+// drawing, so the cost of a tick and of a frame depends on the view and
+// the crowd around Pacman, not on how big the maze is.
+//
+// Ghosts out of range keep their place until Pacman comes back. Each one
+// wanders the maze, and turns after Pacman when he is within CHASE_RADIUS.
+// A ghost that catches him sends him back to the start; the maze keeps
+// its eaten dots.
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "BigMaze.h"
+#include "Map.h"
+#include "PathTable.h"
+#include "Rng.h"
+
+using namespace std;
+
+
+// The rectangle of the maze on screen, in pixels with posX/posY's
+// orientation: x across the columns, y down the rows.
+struct Camera {
+    int x = 0, y = 0;
+    int w, h;
+
+    Camera(int w, int h) : w(w), h(h) {}
+
+    // Centres on the pixel (px, py), without showing anything past the
+    // maze's edges when the maze is bigger than the view.
+    void follow(int px, int py, int mazeW, int mazeH) {
+        x = px - w / 2;
+        y = py - h / 2;
+        if (x > mazeW - w) x = mazeW - w;
+        if (y > mazeH - h) y = mazeH - h;
+        if (x < 0) x = 0;
+        if (y < 0) y = 0;
+    }
+
+    // Inclusive cell range under the camera.
+    int firstRow() const { return y / CELL_SIZE; }
+    int lastRow() const { return (y + h - 1) / CELL_SIZE; }
+    int firstCol() const { return x / CELL_SIZE; }
+    int lastCol() const { return (x + w - 1) / CELL_SIZE; }
+};
+
+
+struct BigTickResult {
+    bool ateDot = false;
+    bool caught = false;
+};
+
+
+class BigWorld {
+public:
+    static const int ACTIVE_RADIUS = 1;     // chunks around Pacman's that are made and simulated
+    static const int GHOSTS_PER_CHUNK = 2;
+    static const int CHASE_RADIUS = 12;     // cells, straight-line per axis
+
+    struct Ghost {
+        int x, y, prevX, prevY;
+        unsigned char dir, sprite;
+    };
+
+private:
+    BigMaze maze;
+    Rng rng;
+    int startX, startY;
+    int pacX, pacY, prevPacX, prevPacY;
+    int intent = DIR_NONE;
+    int score = 0, deaths = 0, frame = 0;
+    vector<Ghost> ghosts;
+    vector<int> active;                     // this tick's simulated ghosts, in a fixed order
+    long long activeTotal = 0;
+
+    static void stepDir(int& x, int& y, int dir) {
+        if (dir == DIR_UP) x--;
+        else if (dir == DIR_DOWN) x++;
+        else if (dir == DIR_LEFT) y--;
+        else if (dir == DIR_RIGHT) y++;
+    }
+
+    unsigned exitsOf(int x, int y) const {
+        unsigned e = 0;
+        if (!maze.isWall(x, y - 1)) e |= dirBit(DIR_LEFT);
+        if (!maze.isWall(x + 1, y)) e |= dirBit(DIR_DOWN);
+        if (!maze.isWall(x, y + 1)) e |= dirBit(DIR_RIGHT);
+        if (!maze.isWall(x - 1, y)) e |= dirBit(DIR_UP);
+        return e;
+    }
+
+    // Makes the chunk, and its ghosts, the first time it is needed. The
+    // ghosts come from the chunk's own seed, on rooms of the chunk.
+    void ensure(int cx, int cy) {
+        if (maze.chunk(cx, cy) || !maze.ensure(cx, cy)) return;
+        MazeChunk& c = *maze.chunk(cx, cy);
+        Rng place(~maze.chunkSeed(cx, cy));
+        c.ghosts.reserve(GHOSTS_PER_CHUNK * 2);
+        for (int k = 0; k < GHOSTS_PER_CHUNK; k++) {
+            int x = cx * CHUNK_SIZE + (int)place.below(CHUNK_SIZE / 2) * 2 + 1;
+            int y = cy * CHUNK_SIZE + (int)place.below(CHUNK_SIZE / 2) * 2 + 1;
+            if (abs(x - startX) + abs(y - startY) <= CHASE_RADIUS) continue;
+            c.ghosts.push_back((int)ghosts.size());
+            ghosts.push_back({ x, y, x, y, (unsigned char)DIR_NONE, (unsigned char)(place.below(5)) });
+        }
+    }
+
+    void moveGhost(int id) {
+        Ghost& g = ghosts[id];
+        g.prevX = g.x;
+        g.prevY = g.y;
+        unsigned exits = exitsOf(g.x, g.y);
+        if (!exits) return;
+        unsigned back = g.dir != DIR_NONE ? dirBit(PathTable::opposite(g.dir)) : 0;
+        if (exits & ~back) exits &= ~back;
+
+        int pick = DIR_NONE;
+        if (abs(g.x - pacX) <= CHASE_RADIUS && abs(g.y - pacY) <= CHASE_RADIUS && rng.below(4) != 0) {
+            int best = INT32_MAX;
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                if (!(exits & dirBit(d))) continue;
+                int x = g.x, y = g.y;
+                stepDir(x, y, d);
+                int dist = abs(x - pacX) + abs(y - pacY);
+                if (dist < best) { best = dist; pick = d; }
+            }
+        }
+        else {
+            int k = (int)rng.below(popcount64(exits));
+            for (int d = DIR_LEFT; d <= DIR_UP; d++)
+                if ((exits & dirBit(d)) && k-- == 0) { pick = d; break; }
+        }
+
+        g.dir = (unsigned char)pick;
+        int cx = BigMaze::chunkOf(g.x), cy = BigMaze::chunkOf(g.y);
+        stepDir(g.x, g.y, pick);
+        int nx = BigMaze::chunkOf(g.x), ny = BigMaze::chunkOf(g.y);
+        if (nx != cx || ny != cy) {
+            vector<int>& from = maze.chunk(cx, cy)->ghosts;
+            for (size_t i = 0; i < from.size(); i++)
+                if (from[i] == id) { from[i] = from.back(); from.pop_back(); break; }
+            maze.chunk(nx, ny)->ghosts.push_back(id);
+        }
+    }
+
+    // A ghost ended the tick on Pacman's cell, or swapped cells with him.
+    bool caughtBy(const MazeChunk* c) const {
+        if (!c) return false;
+        for (int id : c->ghosts) {
+            const Ghost& g = ghosts[id];
+            if (g.x == pacX && g.y == pacY) return true;
+            if (g.x == prevPacX && g.y == prevPacY && g.prevX == pacX && g.prevY == pacY) return true;
+        }
+        return false;
+    }
+
+public:
+    BigWorld(int size, uint64_t seed) : maze(size, seed), rng(seed) {
+        startX = (maze.getRows() / 2) | 1;
+        startY = (maze.getCols() / 2) | 1;
+        pacX = prevPacX = startX;
+        pacY = prevPacY = startY;
+        ensureAround(pacX, pacY);
+    }
+
+    // Makes every chunk within ACTIVE_RADIUS of the one holding (x, y).
+    void ensureAround(int x, int y) {
+        int cx = BigMaze::chunkOf(x), cy = BigMaze::chunkOf(y);
+        for (int i = cx - ACTIVE_RADIUS; i <= cx + ACTIVE_RADIUS; i++)
+            for (int j = cy - ACTIVE_RADIUS; j <= cy + ACTIVE_RADIUS; j++)
+                ensure(i, j);
+    }
+
+    BigTickResult step(int input) {
+        BigTickResult r;
+        frame++;
+        if (input != DIR_NONE) intent = input;
+        prevPacX = pacX;
+        prevPacY = pacY;
+        ensureAround(pacX, pacY);
+
+        if (intent != DIR_NONE && (exitsOf(pacX, pacY) & dirBit(intent))) {
+            stepDir(pacX, pacY, intent);
+            if (maze.eatDot(pacX, pacY)) {
+                score++;
+                r.ateDot = true;
+            }
+        }
+
+        // Gathered before any of them moves, so a ghost that crosses into
+        // a chunk still to come is not moved twice.
+        active.clear();
+        int cx = BigMaze::chunkOf(prevPacX), cy = BigMaze::chunkOf(prevPacY);
+        for (int i = cx - ACTIVE_RADIUS; i <= cx + ACTIVE_RADIUS; i++)
+            for (int j = cy - ACTIVE_RADIUS; j <= cy + ACTIVE_RADIUS; j++)
+                if (const MazeChunk* c = maze.chunk(i, j))
+                    active.insert(active.end(), c->ghosts.begin(), c->ghosts.end());
+        for (int id : active) moveGhost(id);
+        activeTotal += (long long)active.size();
+
+        const MazeChunk* here = maze.chunk(BigMaze::chunkOf(pacX), BigMaze::chunkOf(pacY));
+        const MazeChunk* before = maze.chunk(BigMaze::chunkOf(prevPacX), BigMaze::chunkOf(prevPacY));
+        if (caughtBy(here) || (before != here && caughtBy(before))) {
+            r.caught = true;
+            deaths++;
+            pacX = prevPacX = startX;
+            pacY = prevPacY = startY;
+            intent = DIR_NONE;
+        }
+        return r;
+    }
+
+    // Calls f(x, y, WALL or DOT) for every wall and dot under the camera,
+    // a chunk row at a time off the bit layers.
+    template <class F> void forEachVisibleCell(const Camera& cam, F f) const {
+        int r0 = cam.firstRow(), r1 = cam.lastRow(), c0 = cam.firstCol(), c1 = cam.lastCol();
+        for (int cx = BigMaze::chunkOf(r0); cx <= BigMaze::chunkOf(r1); cx++)
+            for (int cy = BigMaze::chunkOf(c0); cy <= BigMaze::chunkOf(c1); cy++) {
+                const MazeChunk* c = maze.chunk(cx, cy);
+                if (!c) continue;
+                int baseX = cx * CHUNK_SIZE, baseY = cy * CHUNK_SIZE;
+                int lr0 = r0 > baseX ? r0 - baseX : 0;
+                int lr1 = r1 < baseX + CHUNK_SIZE - 1 ? r1 - baseX : CHUNK_SIZE - 1;
+                int lc0 = c0 > baseY ? c0 - baseY : 0;
+                int lc1 = c1 < baseY + CHUNK_SIZE - 1 ? c1 - baseY : CHUNK_SIZE - 1;
+                uint32_t cols = (uint32_t)(((2ull << lc1) - 1) & ~((1ull << lc0) - 1));
+                for (int lr = lr0; lr <= lr1; lr++) {
+                    for (uint32_t m = MazeChunk::rowBits(c->walls, lr) & cols; m; m &= m - 1)
+                        f(baseX + lr, baseY + ctz32(m), WALL);
+                    for (uint32_t m = MazeChunk::rowBits(c->dots, lr) & cols; m; m &= m - 1)
+                        f(baseX + lr, baseY + ctz32(m), DOT);
+                }
+            }
+    }
+
+    // Calls f(ghost) for every ghost under the camera.
+    template <class F> void forEachVisibleGhost(const Camera& cam, F f) const {
+        int r0 = cam.firstRow(), r1 = cam.lastRow(), c0 = cam.firstCol(), c1 = cam.lastCol();
+        for (int cx = BigMaze::chunkOf(r0); cx <= BigMaze::chunkOf(r1); cx++)
+            for (int cy = BigMaze::chunkOf(c0); cy <= BigMaze::chunkOf(c1); cy++)
+                if (const MazeChunk* c = maze.chunk(cx, cy))
+                    for (int id : c->ghosts) {
+                        const Ghost& g = ghosts[id];
+                        if (g.x >= r0 && g.x <= r1 && g.y >= c0 && g.y <= c1) f(g);
+                    }
+    }
+
+    const BigMaze& getMaze() const { return maze; }
+    int getPacX() const { return pacX; }
+    int getPacY() const { return pacY; }
+    int getPrevPacX() const { return prevPacX; }
+    int getPrevPacY() const { return prevPacY; }
+    int getIntent() const { return intent; }
+    int getScore() const { return score; }
+    int getDeaths() const { return deaths; }
+    int getFrame() const { return frame; }
+    int ghostCount() const { return (int)ghosts.size(); }
+    int activeGhosts() const { return (int)active.size(); }
+    double meanActiveGhosts() const { return frame ? (double)activeTotal / frame : 0; }
+    unsigned pacExits() const { return exitsOf(pacX, pacY); }
+};
@@ -0,0 +1,526 @@
+// pacman_server: many games at once, headless, for clients on a
+// Unix-domain socket (Linux only; see ServerProtocol.h for the wire
+// format).
+//
+//   pacman_server [--socket PATH] [--shards N] [--tick-ms MS] [--seed N] [--report SECONDS]
+//
+// The main thread accepts connections and hands each one to the shard
+// with the fewest sessions. A shard is a thread pinned to a core with its
+// own epoll loop: it reads its sessions' key presses as they come and, on
+// a timerfd at the tick rate, steps every one of its games and writes each
+// client the tick's frame. Sessions never move between shards, so nothing
+// on the tick path is shared.
+//
+// A session plays by the front end's rules without its window: the same
+// Simulation, the same turn buffer for key presses, the same pauses before
+// play and after a level, a death or the end. A game that ends is followed
+// by a new one on the next seed until the client hangs up.
+//
+// Every --report seconds the server prints, per shard, the sessions it
+// holds, how late its ticks started and how long they took to run.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "InputQueue.h"
+#include "ServerProtocol.h"
+#include "Sim.h"
+
+using namespace std;
+
+
+const int MAX_BACKLOG = 64 * 1024;     // bytes a client may fall behind before it is dropped
+const int EPOLL_BATCH = 256;
+
+
+struct ServerOptions {
+    const char* socketPath = DEFAULT_SERVER_SOCKET;
+    int shards = 0;                     // 0: one per core
+    double tickMs = 1000.0 / FPS;
+    uint64_t seed = 1;
+    double reportSeconds = 5;
+};
+
+
+struct Session {
+    int fd;
+    uint32_t id;
+    uint64_t nextSeed;
+    Simulation sim;
+    InputQueue turns;
+    FrameEncoder frames;
+    int pause = 0;                      // ticks until the game steps again
+    bool restart = false;               // the game is over; a new one follows the pause
+    uint32_t tick = 0;
+    vector<uint8_t> out;                // bytes the socket has not taken yet
+    size_t index = 0;                   // in Shard::sessions
+
+    Session(int fd, uint32_t id, uint64_t seed) : fd(fd), id(id), nextSeed(seed + 1), sim(seed) {}
+};
+
+
+// Tick timings of a shard over one report period, in microseconds.
+struct ShardReport {
+    int sessions = 0;
+    long long ticks = 0, frames = 0, dropped = 0;
+    vector<float> lateUs, workUs;
+};
+
+
+class Shard {
+    int index;
+    const ServerOptions& opts;
+    uint32_t tickUs;
+    int epollFd = -1, timerFd = -1, wakeFd = -1;
+    vector<unique_ptr<Session>> sessions;
+    vector<unique_ptr<Session>> closed;     // freed after the epoll batch that closed them
+    uint64_t nextTickNs = 0;
+
+    mutex lock;                             // guards inbox and report
+    vector<pair<int, uint32_t>> inbox;      // accepted fds and their session ids
+    ShardReport report;
+    atomic<int> load{ 0 };                  // sessions, counting the inbox
+
+    // epoll tags for the shard's own descriptors; sessions use their pointer.
+    static char TIMER_TAG, WAKE_TAG;
+
+    // At least one tick for any pause, however long the ticks.
+    int ticksFor(double seconds) const {
+        return seconds > 0 ? max(1, (int)(seconds * 1e6 / tickUs + 0.5)) : 0;
+    }
+
+    void watch(Session& s, bool writable) {
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP | (writable ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.ptr = &s;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, s.fd, &ev);
+    }
+
+    void adopt(int fd, uint32_t id) {
+        unique_ptr<Session> s(new Session(fd, id, opts.seed + (uint64_t)id * 1000003));
+        s->pause = ticksFor(READY_PAUSE);
+        s->index = sessions.size();
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = s.get();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            load--;
+            return;
+        }
+        Session& added = *s;
+        sessions.push_back(move(s));
+        ServerHello hello = { PROTOCOL_MAGIC, PROTOCOL_VERSION, (uint16_t)opts.shards, tickUs, id };
+        send(added, (const uint8_t*)&hello, sizeof(hello));
+    }
+
+    void drop(Session& s) {
+        if (s.fd < 0) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, s.fd, nullptr);
+        close(s.fd);
+        s.fd = -1;
+        size_t i = s.index;
+        closed.push_back(move(sessions[i]));
+        if (i + 1 < sessions.size()) {
+            sessions[i] = move(sessions.back());
+            sessions[i]->index = i;
+        }
+        sessions.pop_back();
+        load--;
+    }
+
+    // Queues what the socket will not take now; a client too far behind
+    // is dropped rather than buffered without end.
+    void send(Session& s, const uint8_t* data, size_t n) {
+        if (s.fd < 0) return;
+        if (s.out.empty()) {
+            ssize_t w = ::send(s.fd, data, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w == (ssize_t)n) return;
+            if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop(s);
+                return;
+            }
+            if (w > 0) {
+                data += w;
+                n -= (size_t)w;
+            }
+            watch(s, true);
+        }
+        if (s.out.size() + n > MAX_BACKLOG) {
+            {
+                lock_guard<mutex> g(lock);
+                report.dropped++;
+            }
+            drop(s);
+            return;
+        }
+        s.out.insert(s.out.end(), data, data + n);
+    }
+
+    void flush(Session& s) {
+        while (!s.out.empty()) {
+            ssize_t w = ::send(s.fd, s.out.data(), s.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) drop(s);
+                return;
+            }
+            s.out.erase(s.out.begin(), s.out.begin() + w);
+        }
+        watch(s, false);
+    }
+
+    void receive(Session& s, double now) {
+        uint8_t buf[256];
+        for (;;) {
+            ssize_t n = recv(s.fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                drop(s);
+                return;
+            }
+            if (n < 0) return;
+            for (ssize_t i = 0; i < n; i++) {
+                if (buf[i] > DIR_UP) {
+                    drop(s);
+                    return;
+                }
+                s.turns.push(buf[i], now);
+            }
+        }
+    }
+
+    // Steps the session's game, unless it is in a pause, and sends the
+    // frame for the tick.
+    void advance(Session& s, uint64_t tickNs) {
+        TickResult r;
+        bool stepped = false;
+        int points = 0;
+        if (s.pause > 0) {
+            if (--s.pause == 0 && s.restart) {
+                s.sim.reset(s.nextSeed++);
+                s.turns.clear();
+                s.frames.restart();
+                s.restart = false;
+                s.pause = ticksFor(READY_PAUSE);
+            }
+            // As the front end does: presses made during the pause count
+            // their window from when play goes on.
+            if (s.pause == 0) s.turns.resume(tickNs / 1e9);
+        }
+        else {
+            int score = s.sim.getScore();
+            r = s.sim.step(s.turns.take(s.sim, tickNs / 1e9));
+            stepped = true;
+            points = s.sim.getScore() - score;
+            s.pause = ticksFor(pauseAfter(r));
+            s.restart = r.gameOver || r.won;
+        }
+
+        uint8_t frame[MAX_FRAME];
+        uint16_t size = s.frames.encode(frame, s.tick++, tickNs, s.sim, stepped ? &r : nullptr, points);
+        send(s, frame, size);
+    }
+
+    void tick() {
+        uint64_t expirations;
+        if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+        uint64_t t0 = monotonicNs();
+        uint64_t late = t0 > nextTickNs ? t0 - nextTickNs : 0;
+        nextTickNs += expirations * tickUs * 1000ull;
+
+        // Backwards, so a session dropped by its send is swapped in from
+        // the end, which was already done.
+        long long frames = (long long)sessions.size();
+        for (size_t i = sessions.size(); i-- > 0;)
+            advance(*sessions[i], t0);
+
+        float work = (float)((monotonicNs() - t0) / 1000.0);
+        lock_guard<mutex> g(lock);
+        report.ticks++;
+        report.frames += frames;
+        report.lateUs.push_back((float)(late / 1000.0));
+        report.workUs.push_back(work);
+    }
+
+    void adoptInbox() {
+        uint64_t n;
+        if (read(wakeFd, &n, sizeof(n)) != sizeof(n)) return;
+        vector<pair<int, uint32_t>> fds;
+        {
+            lock_guard<mutex> g(lock);
+            fds.swap(inbox);
+        }
+        for (auto& f : fds) adopt(f.first, f.second);
+    }
+
+public:
+    Shard(int index, const ServerOptions& opts) : index(index), opts(opts) {
+        tickUs = (uint32_t)(opts.tickMs * 1000 + 0.5);
+    }
+
+    ~Shard() {
+        for (auto& s : sessions) close(s->fd);
+        if (epollFd >= 0) close(epollFd);
+        if (timerFd >= 0) close(timerFd);
+        if (wakeFd >= 0) close(wakeFd);
+    }
+
+    bool open() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || timerFd < 0 || wakeFd < 0) return false;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &TIMER_TAG;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+        ev.data.ptr = &WAKE_TAG;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+        return true;
+    }
+
+    void run(const atomic<bool>& stop) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % max(1u, thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+        itimerspec period = {};
+        period.it_interval.tv_sec = tickUs / 1000000;
+        period.it_interval.tv_nsec = (long)(tickUs % 1000000) * 1000;
+        period.it_value = period.it_interval;
+        nextTickNs = monotonicNs() + tickUs * 1000ull;
+        timerfd_settime(timerFd, 0, &period, nullptr);
+
+        epoll_event events[EPOLL_BATCH];
+        while (!stop) {
+            int n = epoll_wait(epollFd, events, EPOLL_BATCH, 200);
+            double now = monotonicNs() / 1e9;
+            for (int i = 0; i < n; i++) {
+                void* tag = events[i].data.ptr;
+                if (tag == &TIMER_TAG) tick();
+                else if (tag == &WAKE_TAG) adoptInbox();
+                else {
+                    Session& s = *(Session*)tag;
+                    if (s.fd >= 0 && (events[i].events & EPOLLOUT)) flush(s);
+                    if (s.fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                        receive(s, now);
+                }
+            }
+            closed.clear();
+        }
+    }
+
+    // Called from the acceptor thread.
+    void give(int fd, uint32_t id) {
+        {
+            lock_guard<mutex> g(lock);
+            inbox.emplace_back(fd, id);
+        }
+        load++;         // counted now, so the next accept sees it
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) perror("eventfd");
+    }
+
+    // Takes this period's timings.
+    ShardReport takeReport() {
+        ShardReport r;
+        lock_guard<mutex> g(lock);
+        swap(r, report);
+        r.sessions = load;
+        return r;
+    }
+
+    int getLoad() const { return load; }
+};
+
+char Shard::TIMER_TAG, Shard::WAKE_TAG;
+
+
+static float percentile(vector<float>& v, double q) {
+    if (v.empty()) return 0;
+    size_t i = (size_t)(q * (v.size() - 1) + 0.5);
+    nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void printReport(vector<unique_ptr<Shard>>& shards, double seconds, double tickMs) {
+    printf("%5s %8s %7s %9s %9s %9s %9s %9s %6s %9s\n", "shard", "sessions", "ticks", "frames/s",
+        "late p99", "work p50", "work p99", "work max", "busy", "dropped");
+    int total = 0;
+    double busyTotal = 0;
+    for (size_t i = 0; i < shards.size(); i++) {
+        ShardReport r = shards[i]->takeReport();
+        double workSum = 0;
+        for (float w : r.workUs) workSum += w;
+        double busy = workSum / (seconds * 1e6);
+        total += r.sessions;
+        busyTotal += busy;
+        printf("%5zu %8d %7lld %9.0f %7.2fms %7.3fms %7.3fms %7.3fms %5.1f%% %9lld\n", i, r.sessions, r.ticks,
+            r.frames / seconds, percentile(r.lateUs, 0.99) / 1000, percentile(r.workUs, 0.5) / 1000,
+            percentile(r.workUs, 0.99) / 1000, percentile(r.workUs, 1.0) / 1000, busy * 100, r.dropped);
+    }
+    // Tick work grows with the sessions, so this is where a core would be
+    // spending every tick period on ticks.
+    if (busyTotal > 0 && total > 0)
+        printf("  %d sessions at %.1f ms ticks, about %.0f sessions per core at full load\n",
+            total, tickMs, total / busyTotal);
+    fflush(stdout);
+}
+
+static int listenOn(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sessions are one descriptor each; ask for as many as we are allowed.
+static void raiseFileLimit() {
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+static void usage() {
+    printf("usage: pacman_server [--socket PATH] [--shards N] [--tick-ms MS] [--seed N] [--report SECONDS]\n");
+    printf("  --socket PATH     Unix-domain socket to listen on (default %s)\n", DEFAULT_SERVER_SOCKET);
+    printf("  --shards N        simulation threads, one per core (default: every core)\n");
+    printf("  --tick-ms MS      tick period (default %.1f, the game's pace)\n", 1000.0 / FPS);
+    printf("  --seed N          game seeds are derived from this and the session id\n");
+    printf("  --report SECONDS  how often to print the shard timings (default 5)\n");
+}
+
+int main(int argc, char** argv) {
+    ServerOptions opts;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) opts.socketPath = argv[++i];
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) opts.shards = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tick-ms") == 0 && i + 1 < argc) opts.tickMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) opts.reportSeconds = atof(argv[++i]);
+        else {
+            usage();
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (opts.shards <= 0) opts.shards = max(1, (int)thread::hardware_concurrency());
+    if (opts.tickMs < 0.1) opts.tickMs = 0.1;
+    if (opts.reportSeconds <= 0) opts.reportSeconds = 5;
+    raiseFileLimit();
+
+    // SIGINT and SIGTERM arrive on a descriptor, for the acceptor's loop.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    int sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    int listenFd = listenOn(opts.socketPath);
+    if (listenFd < 0 || sigFd < 0) return 1;
+
+    vector<unique_ptr<Shard>> shards;
+    for (int i = 0; i < opts.shards; i++) {
+        shards.emplace_back(new Shard(i, opts));
+        if (!shards.back()->open()) {
+            perror("shard");
+            return 1;
+        }
+    }
+    atomic<bool> stop{ false };
+    vector<thread> threads;
+    for (auto& s : shards) threads.emplace_back([&s, &stop] { s->run(stop); });
+
+    int reportFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    itimerspec every = {};
+    every.it_interval.tv_sec = (time_t)opts.reportSeconds;
+    every.it_interval.tv_nsec = (long)((opts.reportSeconds - (double)every.it_interval.tv_sec) * 1e9);
+    every.it_value = every.it_interval;
+    timerfd_settime(reportFd, 0, &every, nullptr);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.data.fd = sigFd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, sigFd, &ev);
+    ev.data.fd = reportFd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, reportFd, &ev);
+
+    printf("pacman_server: %s, %d shard(s), %.1f ms ticks\n", opts.socketPath, opts.shards, opts.tickMs);
+    fflush(stdout);
+    uint32_t nextId = 0;
+    uint64_t lastReport = monotonicNs();
+    while (!stop) {
+        epoll_event events[8];
+        int n = epoll_wait(ep, events, 8, -1);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == sigFd) stop = true;
+            else if (fd == reportFd) {
+                uint64_t expirations;
+                if (read(reportFd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+                uint64_t now = monotonicNs();
+                printReport(shards, (now - lastReport) / 1e9, opts.tickMs);
+                lastReport = now;
+            }
+            else {
+                for (;;) {
+                    int c = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (c < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+                        break;
+                    }
+                    Shard* least = shards[0].get();
+                    for (auto& s : shards)
+                        if (s->getLoad() < least->getLoad()) least = s.get();
+                    least->give(c, nextId++);
+                }
+            }
+        }
+    }
+
+    for (thread& t : threads) t.join();
+    close(listenFd);
+    unlink(opts.socketPath);
+    printf("pacman_server: stopped after %u sessions\n", nextId);
+    return 0;
+}
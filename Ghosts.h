@@ -0,0 +1,473 @@
+#pragma once
+// Ghost storage and movement. Ghosts live in one structure-of-arrays group
+// per behaviour, so a tick is a few flat passes over small integer arrays
+// instead of a virtual call per heap object:
+//
+//   1. a scalar pass picks each chaser's step on the JunctionGraph, which
+//      only takes a decision on a node and otherwise follows the corridor,
+//      and rolls the dice for each random ghost;
+//   2. random ghosts check their four candidate moves against the cell's
+//      exits and their last direction, 16 ghosts per SSE2 instruction;
+//   3. every group applies its moves 8 ghosts at a time.
+//
+// An OccupancyGrid follows every move, so collision checks only look at the
+// ghosts on the cells involved.
+//
+// The passes run block by block, LANES ghosts at a time, so the decisions
+// in between stay on the stack. Arrays are padded to a multiple of LANES
+// with ghosts that are never released, so the vector code has no tail.
+#include <cstdint>
+#include <vector>
+#include "JunctionGraph.h"
+#include "Map.h"
+#include "Occupancy.h"
+#include "PathTable.h"
+#include "Rng.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GHOSTS_SSE2 1
+#endif
+
+using namespace std;
+
+
+// Which behaviour a ghost runs; also its group in GhostSet.
+enum GhostKind { GHOST_RANDOM, GHOST_BLINKY, GHOST_PINKY, GHOST_KIND_COUNT };
+static_assert(GHOST_KIND_COUNT + 1 <= ZobristKeys::ACTORS, "every ghost kind needs Zobrist keys");
+
+
+// One ghost as the rest of the program sees it. Pixel positions follow
+// the Entity convention: posX is the column, posY the row.
+struct GhostView {
+    int gridX, gridY, prevGridX, prevGridY;
+    int sprite, kind, delay;
+    bool released;
+
+    int getGridX() const { return gridX; }
+    int getGridY() const { return gridY; }
+    int getPosX() const { return gridY * CELL_SIZE; }
+    int getPosY() const { return gridX * CELL_SIZE; }
+    int getPrevPosX() const { return prevGridY * CELL_SIZE; }
+    int getPrevPosY() const { return prevGridX * CELL_SIZE; }
+    int getSprite() const { return sprite; }
+    int getKind() const { return kind; }
+    int getDelay() const { return delay; }
+    bool isReleased() const { return released; }
+};
+
+
+// Everything GhostSet keeps about one ghost, as plain data for snapshots.
+struct GhostState {
+    short x, y, prevX, prevY;
+    unsigned char kind, sprite, released, lastDir;
+    int delay;
+};
+
+
+// The three passes of a ghost tick as static functions over plain arrays,
+// one block of up to LANES ghosts at a time. GhostSet runs them over its
+// groups; VecEnv runs the same ones over the ghosts of many games at once,
+// which is why whatever differs between games is passed per ghost.
+struct GhostRules {
+    static const int LANES = 16;
+
+    // One block's worth of this tick's decisions, kept on the stack.
+    struct Moves {
+        alignas(16) unsigned char dir[LANES];       // DIR_* to move in
+        alignas(16) unsigned char choice[LANES];    // random: the dice, as a DIR_*
+        alignas(16) unsigned char open[LANES];      // random: exits of the current cell
+        alignas(16) unsigned char stepped[LANES];   // random: moved by the dice, so no tunnel wrap
+    };
+
+    // The dice of the old RandomGhost: 0 up, 1 down, 2 right, 3 left.
+    static int diceDir(uint32_t roll) {
+        static const unsigned char dirs[4] = { DIR_UP, DIR_DOWN, DIR_RIGHT, DIR_LEFT };
+        return dirs[roll];
+    }
+
+    typedef JunctionGraph::Target Target;
+
+    static int chaseStep(const JunctionGraph& graph, int from, const Target& to) {
+        if (from < 0 || to.id < 0) return DIR_NONE;
+        return graph.step(from, to);
+    }
+
+    // Pass 1. Chasers pick their step; random ghosts roll the dice and
+    // load their cell's exits. Random numbers are drawn in spawn order
+    // within the group and only for released ghosts, which keeps games
+    // reproducible by seed.
+    static void chooseSteps(short* x, short* y, const unsigned char* released, unsigned char* lastDir,
+        int n, int kind, const Map& map, const Target& pac, const Target& ambush, Rng& rng,
+        const JunctionGraph& graph, Moves& m)
+    {
+        for (int i = 0; i < n; i++)
+            if (released[i])
+                chooseStep(x[i], y[i], lastDir[i], kind, map, pac, ambush, rng, graph, m, i);
+    }
+
+    // Pass 1 for the released ghost in lane i. A chaser inside a corridor
+    // keeps going the way it came in; only on a node does it look for the
+    // shortest way to its target.
+    static void chooseStep(short& x, short& y, unsigned char& lastDir, int kind, const Map& map,
+        const Target& pac, const Target& ambush, Rng& rng, const JunctionGraph& graph, Moves& m, int i)
+    {
+        // Random steps do not wrap, so a ghost can stand one cell past
+        // the tunnel mouth for a tick.
+        if (map.isTunnelRow(x)) {
+            if (y < 0) y = MAP_COLS - 1;
+            if (y > MAP_COLS - 1) y = 0;
+        }
+
+        if (kind == GHOST_RANDOM) {
+            m.choice[i] = (unsigned char)diceDir(rng.below(4));
+            m.open[i] = map.exits(x, y);
+            return;
+        }
+        int from = graph.idOf(x, y);
+        int d = graph.onward(from, lastDir);
+        if (d == DIR_NONE && kind == GHOST_PINKY) d = chaseStep(graph, from, ambush);
+        if (d == DIR_NONE) d = chaseStep(graph, from, pac);
+        if (d != DIR_NONE) lastDir = (unsigned char)d;
+        m.dir[i] = (unsigned char)d;
+    }
+
+    // Pass 2, random ghosts only. All four candidate moves are checked at
+    // once: the dice's move is taken if the cell has that exit and it does
+    // not reverse the last move. The few ghosts left blocked take the chase
+    // step instead, so the graph is only asked about them; pacOf(i) is
+    // the Target lane i chases.
+    template <class PacOf>
+    static void pickRandomMoves(const short* x, const short* y, const unsigned char* released,
+        unsigned char* lastDir, PacOf pacOf, const JunctionGraph& graph, Moves& m)
+    {
+#ifdef GHOSTS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        auto sel = [](__m128i k, __m128i a, __m128i b) {
+            return _mm_or_si128(_mm_and_si128(k, a), _mm_andnot_si128(k, b));
+            };
+        auto is = [](__m128i v, int k) { return _mm_cmpeq_epi8(v, _mm_set1_epi8((char)k)); };
+        auto when = [](__m128i k, int v) { return _mm_and_si128(k, _mm_set1_epi8((char)v)); };
+
+        __m128i choice = _mm_load_si128((const __m128i*)m.choice);
+        __m128i open = _mm_load_si128((const __m128i*)m.open);
+        __m128i last = _mm_loadu_si128((const __m128i*)lastDir);
+        __m128i held = is(_mm_loadu_si128((const __m128i*)released), 0);
+
+        __m128i bit = _mm_or_si128(_mm_or_si128(when(is(choice, DIR_LEFT), dirBit(DIR_LEFT)),
+            when(is(choice, DIR_DOWN), dirBit(DIR_DOWN))),
+            _mm_or_si128(when(is(choice, DIR_RIGHT), dirBit(DIR_RIGHT)),
+                when(is(choice, DIR_UP), dirBit(DIR_UP))));
+        __m128i reverse = _mm_or_si128(_mm_or_si128(when(is(last, DIR_LEFT), DIR_RIGHT),
+            when(is(last, DIR_RIGHT), DIR_LEFT)),
+            _mm_or_si128(when(is(last, DIR_UP), DIR_DOWN),
+                when(is(last, DIR_DOWN), DIR_UP)));
+        __m128i blocked = _mm_andnot_si128(held, _mm_or_si128(
+            _mm_cmpeq_epi8(_mm_and_si128(open, bit), zero), _mm_cmpeq_epi8(choice, reverse)));
+        __m128i ok = _mm_andnot_si128(_mm_or_si128(blocked, held), _mm_set1_epi8(-1));
+
+        _mm_store_si128((__m128i*)m.dir, _mm_and_si128(ok, choice));
+        _mm_storeu_si128((__m128i*)lastDir, sel(ok, choice, last));
+        _mm_store_si128((__m128i*)m.stepped, _mm_and_si128(ok, _mm_set1_epi8(1)));
+
+        for (unsigned b = (unsigned)_mm_movemask_epi8(blocked); b; b &= b - 1)
+            chaseInstead(x, y, lastDir, ctz32(b), pacOf(ctz32(b)), graph, m);
+#else
+        for (int i = 0; i < LANES; i++) {
+            m.stepped[i] = 0;
+            if (!released[i]) continue;
+            if ((m.open[i] & dirBit(m.choice[i])) && m.choice[i] != PathTable::opposite(lastDir[i])) {
+                m.dir[i] = lastDir[i] = m.choice[i];
+                m.stepped[i] = 1;
+            }
+            else chaseInstead(x, y, lastDir, i, pacOf(i), graph, m);
+        }
+#endif
+    }
+
+    static void chaseInstead(const short* x, const short* y, unsigned char* lastDir, int i,
+        const Target& pac, const JunctionGraph& graph, Moves& m)
+    {
+        int d = chaseStep(graph, graph.idOf(x[i], y[i]), pac);
+        m.dir[i] = (unsigned char)d;
+        if (d != DIR_NONE) lastDir[i] = (unsigned char)d;
+    }
+
+    // Pass 3: remembers the old cell and moves one cell in dir. Table steps
+    // wrap through the tunnel like PathTable::applyDir(); dice steps do not.
+    static void applyMoves(short* x, short* y, short* prevX, short* prevY, int n, const Moves& m) {
+#ifdef GHOSTS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        __m128i dir8 = _mm_load_si128((const __m128i*)m.dir);
+        __m128i step8 = _mm_load_si128((const __m128i*)m.stepped);
+        for (int h = 0; h < n; h += 8) {
+            __m128i dir = h ? _mm_unpackhi_epi8(dir8, zero) : _mm_unpacklo_epi8(dir8, zero);
+            __m128i wrap = _mm_cmpeq_epi16(h ? _mm_unpackhi_epi8(step8, zero)
+                : _mm_unpacklo_epi8(step8, zero), zero);
+            __m128i vx = _mm_loadu_si128((const __m128i*)(x + h));
+            __m128i vy = _mm_loadu_si128((const __m128i*)(y + h));
+            _mm_storeu_si128((__m128i*)(prevX + h), vx);
+            _mm_storeu_si128((__m128i*)(prevY + h), vy);
+
+            // A compare is -1 where true: x - (dir == DOWN) + (dir == UP).
+            vx = _mm_add_epi16(_mm_sub_epi16(vx, _mm_cmpeq_epi16(dir, _mm_set1_epi16(DIR_DOWN))),
+                _mm_cmpeq_epi16(dir, _mm_set1_epi16(DIR_UP)));
+            vy = _mm_add_epi16(_mm_sub_epi16(vy, _mm_cmpeq_epi16(dir, _mm_set1_epi16(DIR_RIGHT))),
+                _mm_cmpeq_epi16(dir, _mm_set1_epi16(DIR_LEFT)));
+            __m128i under = _mm_and_si128(wrap, _mm_cmplt_epi16(vy, zero));
+            __m128i over = _mm_and_si128(wrap, _mm_cmpgt_epi16(vy, _mm_set1_epi16(MAP_COLS - 1)));
+            vy = _mm_add_epi16(vy, _mm_and_si128(under, _mm_set1_epi16(MAP_COLS)));
+            vy = _mm_sub_epi16(vy, _mm_and_si128(over, _mm_set1_epi16(MAP_COLS)));
+
+            _mm_storeu_si128((__m128i*)(x + h), vx);
+            _mm_storeu_si128((__m128i*)(y + h), vy);
+        }
+#else
+        for (int i = 0; i < n; i++) {
+            prevX[i] = x[i];
+            prevY[i] = y[i];
+            int nx = x[i], ny = y[i];
+            if (m.stepped[i]) {
+                if (m.dir[i] == DIR_UP) nx--;
+                else if (m.dir[i] == DIR_DOWN) nx++;
+                else if (m.dir[i] == DIR_LEFT) ny--;
+                else if (m.dir[i] == DIR_RIGHT) ny++;
+            }
+            else PathTable::applyDir(nx, ny, m.dir[i]);
+            x[i] = (short)nx;
+            y[i] = (short)ny;
+        }
+#endif
+    }
+};
+
+
+class GhostSet {
+    static const int LANES = GhostRules::LANES;
+    typedef GhostRules::Moves Moves;
+    typedef GhostRules::Target Target;
+
+    struct Group {
+        int count = 0, live = 0;            // ghosts, released ghosts
+        vector<short> x, y, prevX, prevY;
+        vector<unsigned char> released;
+        vector<unsigned char> lastDir;      // DIR_* of the last move
+        vector<unsigned char> sprite;
+        vector<int> delay;
+        vector<int> spawn;                  // index in GhostSet's spawn order
+
+        void reserve(int n) {
+            x.reserve(n); y.reserve(n); prevX.reserve(n); prevY.reserve(n);
+            released.reserve(n); lastDir.reserve(n); sprite.reserve(n);
+            delay.reserve(n); spawn.reserve(n);
+        }
+
+        void resize(int n) {
+            x.resize(n); y.resize(n); prevX.resize(n); prevY.resize(n);
+            released.resize(n); lastDir.resize(n); sprite.resize(n);
+            delay.resize(n); spawn.resize(n);
+        }
+    };
+
+    struct Slot {
+        unsigned char kind;
+        int index;
+    };
+
+    Group groups[GHOST_KIND_COUNT];
+    vector<Slot> bySpawn;
+    OccupancyGrid grid;
+    uint64_t hash = 0;      // Zobrist: each ghost's kind on its cell
+
+    static const uint64_t* keysOf(int kind) { return ZOBRIST.actor[1 + kind]; }
+
+public:
+    int size() const { return (int)bySpawn.size(); }
+    int countOf(int kind) const { return groups[kind].count; }
+
+    // Room for `n` more ghosts of `kind`, so that clear() and add() up to
+    // that many never allocate.
+    void reserve(int kind, int n) {
+        Group& g = groups[kind];
+        int want = (int)g.x.capacity() + n;
+        g.reserve((want + LANES - 1) / LANES * LANES);
+        bySpawn.reserve(bySpawn.capacity() + n);
+        grid.reserve((int)bySpawn.capacity());
+    }
+
+    void clear() {
+        for (Group& g : groups) {
+            g.count = g.live = 0;
+            g.resize(0);
+        }
+        bySpawn.clear();
+        grid.clear();
+        hash = 0;
+    }
+
+    // Returns the new ghost's spawn index. `delay` is only carried for
+    // whoever schedules the release.
+    int add(int kind, int gx, int gy, int sprite, int delay) {
+        Group& g = groups[kind];
+        int i = g.count++;
+        if (i % LANES == 0) g.resize(i + LANES);
+        g.x[i] = g.prevX[i] = (short)gx;
+        g.y[i] = g.prevY[i] = (short)gy;
+        g.released[i] = 0;
+        g.lastDir[i] = DIR_NONE;
+        g.sprite[i] = (unsigned char)sprite;
+        g.delay[i] = delay;
+        g.spawn[i] = (int)bySpawn.size();
+        bySpawn.push_back({ (unsigned char)kind, i });
+        grid.add(gx, gy);
+        hash ^= keysOf(kind)[actorCell(gx, gy)];
+        return g.spawn[i];
+    }
+
+    void release(int spawn) {
+        const Slot& s = bySpawn[spawn];
+        Group& g = groups[s.kind];
+        if (!g.released[s.index]) g.live++;
+        g.released[s.index] = 1;
+    }
+
+    GhostView get(int spawn) const {
+        const Slot& s = bySpawn[spawn];
+        const Group& g = groups[s.kind];
+        int i = s.index;
+        return { g.x[i], g.y[i], g.prevX[i], g.prevY[i], g.sprite[i], s.kind, g.delay[i],
+            g.released[i] != 0 };
+    }
+
+    GhostState save(int spawn) const {
+        const Slot& s = bySpawn[spawn];
+        const Group& g = groups[s.kind];
+        int i = s.index;
+        return { g.x[i], g.y[i], g.prevX[i], g.prevY[i], s.kind, g.sprite[i], g.released[i],
+            g.lastDir[i], g.delay[i] };
+    }
+
+    // Replaces every ghost with `n` saved ones, in spawn order. Writes over
+    // the arrays in place, so it allocates nothing if the set was reserved
+    // for them.
+    void restore(const GhostState* saved, int n) {
+        for (Group& g : groups) g.count = g.live = 0;
+        bySpawn.clear();
+        grid.clear();
+        hash = 0;
+        for (int k = 0; k < n; k++) {
+            const GhostState& st = saved[k];
+            Group& g = groups[st.kind];
+            int i = g.count++;
+            if (i >= (int)g.x.size()) g.resize(i + LANES);
+            g.x[i] = st.x; g.y[i] = st.y;
+            g.prevX[i] = st.prevX; g.prevY[i] = st.prevY;
+            g.released[i] = st.released;
+            g.live += st.released != 0;
+            g.lastDir[i] = st.lastDir;
+            g.sprite[i] = st.sprite;
+            g.delay[i] = st.delay;
+            g.spawn[i] = k;
+            bySpawn.push_back({ st.kind, i });
+            grid.add(st.x, st.y);
+            hash ^= keysOf(st.kind)[actorCell(st.x, st.y)];
+        }
+        // Padding lanes left over from a larger set must stay unreleased.
+        for (Group& g : groups) {
+            g.resize((g.count + LANES - 1) / LANES * LANES);
+            for (int i = g.count; i < (int)g.released.size(); i++) g.released[i] = 0;
+        }
+    }
+
+    // One tick for every released ghost. The others have never moved, so
+    // their previous cell is already their current one.
+    void move(const Map& map, int pacX, int pacY, Rng& rng, const JunctionGraph& graph) {
+        Target pac = graph.target(graph.idOf(pacX, pacY));
+        Target ambush = graph.target(graph.idOf(pacX + 2, pacY + 2));
+        for (int k = 0; k < GHOST_KIND_COUNT; k++) {
+            Group& g = groups[k];
+            if (g.live == 0) continue;
+            const uint64_t* keys = keysOf(k);
+            for (int b = 0; b < g.count; b += LANES) {
+                Moves m = {};
+                int n = g.count - b < LANES ? g.count - b : LANES;
+                GhostRules::chooseSteps(&g.x[b], &g.y[b], &g.released[b], &g.lastDir[b], n, k, map,
+                    pac, ambush, rng, graph, m);
+                if (k == GHOST_RANDOM)
+                    GhostRules::pickRandomMoves(&g.x[b], &g.y[b], &g.released[b], &g.lastDir[b],
+                        [&pac](int) -> const Target& { return pac; }, graph, m);
+                GhostRules::applyMoves(&g.x[b], &g.y[b], &g.prevX[b], &g.prevY[b], n, m);
+                for (int i = b; i < b + n; i++) {
+                    if (!g.released[i]) continue;
+                    int was = grid.move(g.spawn[i], g.prevX[i], g.prevY[i], g.x[i], g.y[i]);
+                    if (was >= 0) hash ^= keys[was] ^ keys[grid.cellOfGhost(g.spawn[i])];
+                }
+            }
+        }
+    }
+
+    // Zobrist hash of where the ghosts stand, by kind, kept up to date by
+    // every change. Ghosts of one kind are interchangeable, and two of them
+    // on one cell cancel out.
+    uint64_t getHash() const { return hash; }
+
+    // Released ghosts of `kind`.
+    int liveOf(int kind) const { return groups[kind].live; }
+
+    // Spawn index of the first-spawned ghost on (x, y), or -1.
+    int firstAt(int x, int y) const {
+        int best = -1;
+        for (int id = grid.firstAt(x, y); id >= 0; id = grid.nextAt(id))
+            if (best < 0 || id < best) best = id;
+        return best;
+    }
+
+    // Spawn index of the first-spawned ghost that caught Pacman on his move
+    // from (fromX, fromY) to (toX, toY), or -1: one that ended the tick on
+    // his new cell, or one that swapped cells with him on the way.
+    int firstHit(int fromX, int fromY, int toX, int toY) const {
+        int best = firstAt(toX, toY);
+        if (fromX == toX && fromY == toY) return best;
+        for (int id = grid.firstAt(fromX, fromY); id >= 0; id = grid.nextAt(id))
+            if ((best < 0 || id < best) && grid.cameFrom(id, toX, toY)) best = id;
+        return best;
+    }
+
+    // firstHit() by scanning every ghost instead of the grid; the stress
+    // mode checks the two against each other.
+    int scanHit(int fromX, int fromY, int toX, int toY) const {
+        bool moved = fromX != toX || fromY != toY;
+        int best = -1;
+        for (const Group& g : groups) {
+#ifdef GHOSTS_SSE2
+            __m128i tx = _mm_set1_epi16((short)toX), ty = _mm_set1_epi16((short)toY);
+            __m128i fx = _mm_set1_epi16((short)fromX), fy = _mm_set1_epi16((short)fromY);
+            __m128i swap = _mm_set1_epi16(moved ? -1 : 0);
+            for (int i = 0; i < g.count; i += 8) {
+                __m128i x = _mm_loadu_si128((const __m128i*) & g.x[i]);
+                __m128i y = _mm_loadu_si128((const __m128i*) & g.y[i]);
+                __m128i px = _mm_loadu_si128((const __m128i*) & g.prevX[i]);
+                __m128i py = _mm_loadu_si128((const __m128i*) & g.prevY[i]);
+                __m128i on = _mm_and_si128(_mm_cmpeq_epi16(x, tx), _mm_cmpeq_epi16(y, ty));
+                __m128i crossed = _mm_and_si128(
+                    _mm_and_si128(_mm_cmpeq_epi16(x, fx), _mm_cmpeq_epi16(y, fy)),
+                    _mm_and_si128(_mm_cmpeq_epi16(px, tx), _mm_cmpeq_epi16(py, ty)));
+                __m128i hit = _mm_or_si128(on, _mm_and_si128(swap, crossed));
+                unsigned mask = (unsigned)_mm_movemask_epi8(hit) & 0x5555u;  // one bit per lane
+                for (; mask; mask &= mask - 1) {
+                    int lane = i + ctz32(mask) / 2;
+                    if (lane < g.count && (best < 0 || g.spawn[lane] < best)) best = g.spawn[lane];
+                }
+            }
+#else
+            for (int i = 0; i < g.count; i++) {
+                bool on = g.x[i] == toX && g.y[i] == toY;
+                bool crossed = moved && g.x[i] == fromX && g.y[i] == fromY
+                    && g.prevX[i] == toX && g.prevY[i] == toY;
+                if ((on || crossed) && (best < 0 || g.spawn[i] < best)) best = g.spawn[i];
+            }
+#endif
+        }
+        return best;
+    }
+};
@@ -0,0 +1,234 @@
+#pragma once
+// A game recorded as its seed plus the inputs that changed Pacman's intent.
+// The simulation is deterministic given both, so replaying the log
+// re-creates every tick; the outcome stored at the end lets the replay
+// prove it.
+//
+// An input that repeats the current intent changes nothing, so only
+// changes are kept, each as one varint of (frames since the previous
+// change << 3 | DIR_*): a byte or two per turn instead of per-frame state.
+//
+// File layout, little-endian:
+//   "PACLOG1\0"
+//   u64 seed
+//   u32 frames, i32 score, i32 level, i32 deathFrame   (outcome, -1: no death)
+//   u32 changes, u32 bytes
+//   bytes of varints
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Batch.h"
+#include "Sim.h"
+
+using namespace std;
+
+
+// What a game ended on; a replay must reproduce all of it.
+struct GameOutcome {
+    int frames = 0;
+    int score = 0;
+    int level = 1;
+    int deathFrame = -1;    // tick of the latest death, -1 if none
+
+    bool operator==(const GameOutcome& o) const {
+        return frames == o.frames && score == o.score && level == o.level
+            && deathFrame == o.deathFrame;
+    }
+    bool operator!=(const GameOutcome& o) const { return !(*this == o); }
+};
+
+
+class InputLog {
+    static constexpr char MAGIC[8] = { 'P', 'A', 'C', 'L', 'O', 'G', '1', '\0' };
+
+    uint64_t seed = 0;
+    GameOutcome outcome;
+    vector<unsigned char> bytes;
+    int changes = 0;
+    int lastFrame = 0;
+
+    static void putU32(FILE* f, uint32_t v) {
+        unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8),
+            (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+        fwrite(b, 1, 4, f);
+    }
+    static bool getU32(FILE* f, uint32_t& v) {
+        unsigned char b[4];
+        if (fread(b, 1, 4, f) != 4) return false;
+        v = b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+        return true;
+    }
+
+public:
+    // Walks a log's changes in order; input() hands each one out on its tick.
+    class Player {
+        const InputLog* log;
+        size_t pos = 0;
+        int frame = 0, dir = DIR_NONE;
+
+        void advance() {
+            uint32_t v = 0;
+            int shift = 0;
+            if (pos >= log->bytes.size()) { frame = -1; return; }
+            while (pos < log->bytes.size()) {
+                unsigned char b = log->bytes[pos++];
+                v |= (uint32_t)(b & 0x7f) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            frame += (int)(v >> 3);
+            dir = (int)(v & 7);
+        }
+
+    public:
+        explicit Player(const InputLog& l) : log(&l) { advance(); }
+
+        // The input for tick `tick` (frameCount after the step), in order.
+        int input(int tick) {
+            if (frame != tick) return DIR_NONE;
+            int d = dir;
+            advance();
+            return d;
+        }
+    };
+
+    void begin(uint64_t gameSeed) {
+        seed = gameSeed;
+        outcome = GameOutcome();
+        bytes.clear();
+        changes = 0;
+        lastFrame = 0;
+    }
+
+    // Call with the input about to go into sim.step(); keeps it only if it
+    // changes Pacman's intent.
+    void record(const Simulation& sim, int input) {
+        if (input == DIR_NONE || input == sim.getPacman().getIntent()) return;
+        int frame = sim.getFrameCount() + 1;
+        uint32_t v = (uint32_t)(frame - lastFrame) << 3 | (uint32_t)input;
+        lastFrame = frame;
+        changes++;
+        do {
+            unsigned char b = v & 0x7f;
+            v >>= 7;
+            bytes.push_back(v ? b | 0x80 : b);
+        } while (v);
+    }
+
+    // Call after each sim.step() so the stored outcome follows the game.
+    void note(const Simulation& sim) { outcome = outcomeOf(sim); }
+
+    static GameOutcome outcomeOf(const Simulation& sim) {
+        GameOutcome o;
+        o.frames = sim.getFrameCount();
+        o.score = sim.getScore();
+        o.level = sim.getLevel();
+        o.deathFrame = sim.getDeathFrame();
+        return o;
+    }
+
+    // Drops the changes after tick `frame`, for a game rewound to it.
+    void truncate(int frame) {
+        size_t pos = 0, keep = 0;
+        int at = 0, kept = 0, n = 0;
+        while (pos < bytes.size()) {
+            uint32_t v = 0;
+            for (int shift = 0; pos < bytes.size(); shift += 7) {
+                unsigned char b = bytes[pos++];
+                v |= (uint32_t)(b & 0x7f) << shift;
+                if (!(b & 0x80)) break;
+            }
+            at += (int)(v >> 3);
+            if (at > frame) break;
+            keep = pos;
+            kept = at;
+            n++;
+        }
+        bytes.resize(keep);
+        lastFrame = kept;
+        changes = n;
+    }
+
+    uint64_t getSeed() const { return seed; }
+    const GameOutcome& getOutcome() const { return outcome; }
+    int getChanges() const { return changes; }
+    size_t getBytes() const { return bytes.size(); }
+
+    bool save(const char* path) const {
+        FILE* f = fopen(path, "wb");
+        if (!f) return false;
+        fwrite(MAGIC, 1, sizeof(MAGIC), f);
+        putU32(f, (uint32_t)seed);
+        putU32(f, (uint32_t)(seed >> 32));
+        putU32(f, (uint32_t)outcome.frames);
+        putU32(f, (uint32_t)outcome.score);
+        putU32(f, (uint32_t)outcome.level);
+        putU32(f, (uint32_t)outcome.deathFrame);
+        putU32(f, (uint32_t)changes);
+        putU32(f, (uint32_t)bytes.size());
+        fwrite(bytes.data(), 1, bytes.size(), f);
+        return fclose(f) == 0;
+    }
+
+    bool load(const char* path, string& error) {
+        FILE* f = fopen(path, "rb");
+        if (!f) { error = "cannot open"; return false; }
+        char magic[8];
+        uint32_t lo, hi, frames, score, level, death, n, size;
+        bool ok = fread(magic, 1, sizeof(magic), f) == sizeof(magic)
+            && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        if (!ok) { fclose(f); error = "not an input log"; return false; }
+        ok = getU32(f, lo) && getU32(f, hi) && getU32(f, frames) && getU32(f, score)
+            && getU32(f, level) && getU32(f, death) && getU32(f, n) && getU32(f, size);
+        if (ok) {
+            // Trust the stored size only as far as the file goes, so a cut
+            // or damaged header cannot ask for gigabytes.
+            long at = ftell(f);
+            ok = at >= 0 && fseek(f, 0, SEEK_END) == 0;
+            long end = ok ? ftell(f) : -1;
+            ok = ok && end >= at && (uint64_t)size <= (uint64_t)(end - at) && fseek(f, at, SEEK_SET) == 0;
+        }
+        if (ok) {
+            bytes.resize(size);
+            ok = fread(bytes.data(), 1, size, f) == size;
+        }
+        fclose(f);
+        if (!ok) { error = "truncated log"; return false; }
+        seed = (uint64_t)hi << 32 | lo;
+        outcome.frames = (int)frames;
+        outcome.score = (int)score;
+        outcome.level = (int)level;
+        outcome.deathFrame = (int)death;
+        changes = (int)n;
+        lastFrame = 0;
+        return true;
+    }
+};
+
+
+// Re-simulates a log as fast as the simulation runs, with no display, and
+// returns what the game ended on; compare with log.getOutcome().
+inline GameOutcome replayLog(Simulation& sim, const InputLog& log) {
+    sim.reset(log.getSeed());
+    InputLog::Player player(log);
+    while (!sim.isFinished() && sim.getFrameCount() < log.getOutcome().frames)
+        sim.step(player.input(sim.getFrameCount() + 1));
+    return InputLog::outcomeOf(sim);
+}
+
+// Plays one game with `policy` like playGame() and records it.
+inline void recordGame(Simulation& sim, InputLog& log, uint64_t seed, InputPolicy policy,
+    int maxFrames)
+{
+    sim.reset(seed);
+    log.begin(seed);
+    Rng inputRng(~seed);
+    while (!sim.isFinished() && sim.getFrameCount() < maxFrames) {
+        int input = policy(sim, inputRng);
+        log.record(sim, input);
+        sim.step(input);
+        log.note(sim);
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+// Keyboard turns between ticks. Presses are queued with the time they were
+// made instead of overwriting one pending input, and each tick takes the
+// oldest press that Pacman can act on right now:
+//
+//   - a turn pressed before the junction waits, and Pacman keeps going
+//     straight, until the tick he stands where the turn is open;
+//   - two presses between the same pair of ticks are both kept, the
+//     second one for a later tick;
+//   - a press that has not become legal within the buffer window is
+//     dropped, so an old press cannot turn him long after it was meant.
+//
+// The queue only decides which DIR_* each tick is given, so the
+// simulation, its input log and replays are unchanged. A window of 0 is
+// the old behaviour: the latest press goes in at the next tick, legal or
+// not, and anything before it is lost.
+//
+// TurnLatency measures the result: the time from a press to the first
+// tick on which Pacman moves the way it asked.
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "Sim.h"
+
+using namespace std;
+
+
+const double DEFAULT_TURN_BUFFER = 0.3;    // seconds a press may wait for its turn
+
+
+class InputQueue {
+public:
+    struct Press {
+        int dir;
+        double time;    // seconds, on the caller's clock
+    };
+
+private:
+    static const int CAPACITY = 8;
+
+    Press presses[CAPACITY];
+    int head = 0, count = 0;
+    double window;
+    long long dropped = 0;
+
+    const Press& at(int k) const { return presses[(head + k) % CAPACITY]; }
+
+    void popFront(int n) {
+        head = (head + n) % CAPACITY;
+        count -= n;
+    }
+
+    static bool legal(const Simulation& sim, int dir) {
+        const Pacman& pac = sim.getPacman();
+        int x = pac.getGridX(), y = pac.getGridY();
+        return Pacman::moveRule(sim.getMap(), x, y, dir) != DIR_NONE;
+    }
+
+public:
+    explicit InputQueue(double bufferWindow = DEFAULT_TURN_BUFFER) : window(bufferWindow) {}
+
+    void setWindow(double seconds) { window = seconds; }
+    double getWindow() const { return window; }
+
+    // A full queue forgets its oldest press.
+    void push(int dir, double time) {
+        if (dir == DIR_NONE) return;
+        if (count == CAPACITY) {
+            popFront(1);
+            dropped++;
+        }
+        presses[(head + count++) % CAPACITY] = { dir, time };
+    }
+
+    void clear() { head = count = 0; }
+    bool empty() const { return count == 0; }
+
+    // Presses made while the game was paused wait from `t`, when it goes on.
+    void resume(double t) {
+        for (int k = 0; k < count; k++) {
+            Press& p = presses[(head + k) % CAPACITY];
+            if (p.time < t) p.time = t;
+        }
+    }
+
+    // The input for the tick about to run at `now`, DIR_NONE to keep
+    // Pacman's intent. `pressedAt` gets the time of the press used.
+    int take(const Simulation& sim, double now, double* pressedAt = nullptr) {
+        if (count == 0) return DIR_NONE;
+        if (window <= 0) {
+            const Press& last = at(count - 1);
+            if (pressedAt) *pressedAt = last.time;
+            int dir = last.dir;
+            dropped += count - 1;
+            clear();
+            return dir;
+        }
+
+        while (count > 0 && now - at(0).time > window) {
+            popFront(1);
+            dropped++;
+        }
+        // Pressing the way he already goes asks nothing of this tick. Such a
+        // press behind a waiting turn stays: it is the turn after that one.
+        int intent = sim.getPacman().getIntent();
+        while (count > 0 && at(0).dir == intent) popFront(1);
+        for (int k = 0; k < count; k++) {
+            const Press& p = at(k);
+            if (p.dir == intent || !legal(sim, p.dir)) continue;
+            // Anything older was overtaken by this press.
+            int dir = p.dir;
+            if (pressedAt) *pressedAt = p.time;
+            dropped += k;
+            popFront(k + 1);
+            return dir;
+        }
+        return DIR_NONE;
+    }
+
+    // Presses that never went in: expired, overwritten or overflowed.
+    long long getDropped() const { return dropped; }
+};
+
+
+class TurnLatency {
+    static constexpr double GIVE_UP = 1.0;     // seconds before a press counts as lost
+
+    struct Waiting {
+        int dir;
+        double time;
+    };
+    vector<Waiting> waiting;
+    vector<double> samples;         // ms
+    long long lost = 0;
+
+public:
+    void pressed(int dir, double time) {
+        if (dir != DIR_NONE) waiting.push_back({ dir, time });
+    }
+
+    // After each tick: `moved` is the DIR_* Pacman just moved in, or
+    // DIR_NONE if he stood still.
+    void ticked(int moved, double now) {
+        size_t keep = 0;
+        for (const Waiting& w : waiting) {
+            if (moved != DIR_NONE && w.dir == moved && w.time <= now)
+                samples.push_back((now - w.time) * 1000);
+            else if (now - w.time > GIVE_UP)
+                lost++;
+            else
+                waiting[keep++] = w;
+        }
+        waiting.resize(keep);
+    }
+
+    void clear() {
+        waiting.clear();
+        samples.clear();
+        lost = 0;
+    }
+
+    long long count() const { return (long long)samples.size(); }
+    long long getLost() const { return lost; }
+
+    // Mean and the given quantile of press-to-move times, in ms.
+    double mean() const {
+        double s = 0;
+        for (double v : samples) s += v;
+        return samples.empty() ? 0 : s / samples.size();
+    }
+    double quantile(double q) {
+        if (samples.empty()) return 0;
+        size_t i = (size_t)(q * (samples.size() - 1) + 0.5);
+        nth_element(samples.begin(), samples.begin() + i, samples.end());
+        return samples[i];
+    }
+
+    void print(FILE* out, const char* label) {
+        long long n = count();
+        fprintf(out, "%s: %lld turns, mean %.1f ms, p50 %.1f ms, p95 %.1f ms, max %.1f ms, %lld lost (%.1f%%)\n",
+            label, n, mean(), quantile(0.5), quantile(0.95), quantile(1.0), lost,
+            n + lost ? 100.0 * lost / (n + lost) : 0.0);
+    }
+};
@@ -0,0 +1,341 @@
+#pragma once
+// The maze compiled into a graph: nodes where a ghost has a real choice
+// (junctions and dead ends), corridors between them as edges with lengths.
+// Shortest paths are kept only between nodes, so the tables grow with the
+// square of the junction count instead of the square of the cell count
+// like PathTable's; a cell inside a corridor just compares its two ends.
+// GhostSet moves the ghosts on it: a chaser only decides on a node and
+// follows its corridor with onward() in between.
+//
+// Cells and moves follow PathTable: every column wraps, and only cells
+// reachable from the start cell are part of the graph.
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Map.h"
+#include "PathTable.h"
+
+using namespace std;
+
+
+class JunctionGraph {
+public:
+    struct End {
+        int node, cost, dir;        // node reached, steps to it, first of them
+    };
+
+    struct Corridor {
+        int a, b;                   // end nodes; a == b for a loop
+        unsigned char exitA, exitB; // direction that leaves a (b) into the corridor
+        int length;                 // steps from a to b
+        int first;                  // interior cells are path[first .. first + length - 2], from a
+    };
+
+private:
+    static const int ROWS = MAP_ROWS, COLS = MAP_COLS;
+
+    short cellId[ROWS][COLS];
+    vector<short> cellX, cellY;
+    vector<int> nbr;                        // [cell * 4 + dir - 1], -1 for walls
+    vector<int> nodeOf;                     // cell -> node, -1 inside a corridor
+    vector<int> nodeCell;
+    vector<Corridor> corridors;
+    vector<int> path;
+    vector<int> corridorOf, offset;         // interior cell -> corridor, steps from its a end
+    vector<unsigned char> toA, toB;         // interior cell -> direction towards each end
+    vector<int> dist;                       // [node * nodes + node]
+    vector<unsigned char> firstStep;        // [node * nodes + node], DIR_*
+
+    int neighbour(int c, int dir) const { return nbr[c * 4 + dir - 1]; }
+
+    int degree(int c) const {
+        int n = 0;
+        for (int d = DIR_LEFT; d <= DIR_UP; d++) n += neighbour(c, d) >= 0;
+        return n;
+    }
+
+    // Follows the corridor that leaves node cell `from` by `dir` to the
+    // next node, unless it was already walked from the other end.
+    void walk(int from, int dir) {
+        int prev = from, cur = neighbour(from, dir), arrive = dir;
+        if (nodeOf[cur] >= 0) {
+            // Adjacent nodes: record the edge once, from the lower cell.
+            if (cur > from) {
+                Corridor k = { nodeOf[from], nodeOf[cur], (unsigned char)dir,
+                    (unsigned char)PathTable::opposite(dir), 1, (int)path.size() };
+                corridors.push_back(k);
+            }
+            return;
+        }
+        if (corridorOf[cur] >= 0) return;
+
+        Corridor k;
+        k.a = nodeOf[from];
+        k.exitA = (unsigned char)dir;
+        k.first = (int)path.size();
+        int id = (int)corridors.size(), steps = 1;
+        while (nodeOf[cur] < 0) {
+            corridorOf[cur] = id;
+            offset[cur] = steps;
+            toA[cur] = (unsigned char)PathTable::opposite(arrive);
+            path.push_back(cur);
+            int next = -1, nextDir = DIR_NONE;
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                int n = neighbour(cur, d);
+                if (n >= 0 && n != prev && d != PathTable::opposite(arrive)) { next = n; nextDir = d; break; }
+            }
+            toB[cur] = (unsigned char)nextDir;
+            prev = cur;
+            cur = next;
+            arrive = nextDir;
+            steps++;
+        }
+        k.b = nodeOf[cur];
+        k.exitB = (unsigned char)PathTable::opposite(arrive);
+        k.length = steps;
+        corridors.push_back(k);
+    }
+
+    int addNode(int c) {
+        nodeOf[c] = (int)nodeCell.size();
+        nodeCell.push_back(c);
+        return nodeOf[c];
+    }
+
+public:
+    JunctionGraph(const Map& map, int startX, int startY) {
+        memset(cellId, -1, sizeof(cellId));
+        cellId[startX][startY] = 0;
+        cellX.push_back((short)startX);
+        cellY.push_back((short)startY);
+        for (size_t head = 0; head < cellX.size(); head++)
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                int nx = cellX[head], ny = cellY[head];
+                PathTable::applyDir(nx, ny, d);
+                if (nx < 0 || nx >= ROWS) continue;
+                if (cellId[nx][ny] >= 0 || map.isWall(nx, ny)) continue;
+                cellId[nx][ny] = (short)cellX.size();
+                cellX.push_back((short)nx);
+                cellY.push_back((short)ny);
+            }
+
+        int n = cellCount();
+        nbr.assign((size_t)n * 4, -1);
+        for (int c = 0; c < n; c++)
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                int nx = cellX[c], ny = cellY[c];
+                PathTable::applyDir(nx, ny, d);
+                nbr[c * 4 + d - 1] = idOf(nx, ny);
+            }
+
+        nodeOf.assign(n, -1);
+        corridorOf.assign(n, -1);
+        offset.assign(n, 0);
+        toA.assign(n, DIR_NONE);
+        toB.assign(n, DIR_NONE);
+        for (int c = 0; c < n; c++)
+            if (degree(c) != 2) addNode(c);
+        // A ring with no junction on it still needs one node.
+        if (nodeCell.empty()) addNode(0);
+
+        for (size_t i = 0; i < nodeCell.size(); i++)
+            for (int d = DIR_LEFT; d <= DIR_UP; d++)
+                if (neighbour(nodeCell[i], d) >= 0) walk(nodeCell[i], d);
+
+        int m = nodeCount();
+        dist.assign((size_t)m * m, 0);
+        firstStep.assign((size_t)m * m, DIR_NONE);
+        vector<int> cellDist(n), queue(n);
+        for (int t = 0; t < m; t++) {
+            fill(cellDist.begin(), cellDist.end(), -1);
+            int head = 0, tail = 0;
+            cellDist[nodeCell[t]] = 0;
+            queue[tail++] = nodeCell[t];
+            while (head < tail) {
+                int c = queue[head++];
+                for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                    int nb = neighbour(c, d);
+                    if (nb >= 0 && cellDist[nb] < 0) {
+                        cellDist[nb] = cellDist[c] + 1;
+                        queue[tail++] = nb;
+                    }
+                }
+            }
+            for (int s = 0; s < m; s++) {
+                int c = nodeCell[s];
+                dist[(size_t)s * m + t] = cellDist[c];
+                for (int d = DIR_LEFT; d <= DIR_UP && s != t; d++) {
+                    int nb = neighbour(c, d);
+                    if (nb >= 0 && cellDist[nb] == cellDist[c] - 1) {
+                        firstStep[(size_t)s * m + t] = (unsigned char)d;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    int cellCount() const { return (int)cellX.size(); }
+    int nodeCount() const { return (int)nodeCell.size(); }
+    int corridorCount() const { return (int)corridors.size(); }
+    const Corridor& corridor(int i) const { return corridors[i]; }
+    int cellRow(int id) const { return cellX[id]; }
+    int cellCol(int id) const { return cellY[id]; }
+    bool isNode(int id) const { return nodeOf[id] >= 0; }
+
+    // -1 for walls and anything outside the reachable maze.
+    int idOf(int x, int y) const {
+        if (x < 0 || x >= ROWS) return -1;
+        if (y < 0) y += COLS;
+        if (y >= COLS) y -= COLS;
+        if (y < 0 || y >= COLS) return -1;
+        return cellId[x][y];
+    }
+
+    // The cell `steps` along corridor k from its a end, in O(1); 0 and
+    // length are the end nodes.
+    int cellAlong(int k, int steps) const {
+        const Corridor& c = corridors[k];
+        if (steps <= 0) return nodeCell[c.a];
+        if (steps >= c.length) return nodeCell[c.b];
+        return path[c.first + steps - 1];
+    }
+
+    // Length of a shortest path between two cells.
+    int distance(int fromX, int fromY, int toX, int toY) const {
+        int d;
+        route(idOf(fromX, fromY), idOf(toX, toY), d);
+        return d;
+    }
+
+    // First step of a shortest path, or DIR_NONE if the cells are the same
+    // or either is not part of the maze. Inside a corridor this is two
+    // comparisons; only nodes consult the node-to-node table.
+    int nextDir(int fromX, int fromY, int toX, int toY) const {
+        int d;
+        return route(idOf(fromX, fromY), idOf(toX, toY), d);
+    }
+
+    // A cell to head for, looked up once for every ghost that heads there
+    // this tick.
+    struct Target {
+        int id;                     // -1 if not part of the maze
+        int ends;
+        End end[2];
+    };
+
+    Target target(int id) const {
+        Target t;
+        t.id = id;
+        t.ends = id >= 0 ? endsOf(id, t.end) : 0;
+        return t;
+    }
+
+    // Same as nextDir() for a cell already turned into an id with idOf().
+    int step(int from, const Target& to) const {
+        int d;
+        return route(from, to, d);
+    }
+
+    // The way on along the corridor for something that moved into cell
+    // `id` going `dir`, in O(1). DIR_NONE on a node, where there is a
+    // choice to make, or if `dir` did not come along the corridor.
+    int onward(int id, int dir) const {
+        if (id < 0 || nodeOf[id] >= 0) return DIR_NONE;
+        int back = PathTable::opposite(dir);
+        if (back == toA[id]) return toB[id];
+        if (back == toB[id]) return toA[id];
+        return DIR_NONE;
+    }
+
+    size_t bytes() const {
+        return sizeof(*this) + (cellX.capacity() + cellY.capacity()) * sizeof(short)
+            + (nbr.capacity() + nodeOf.capacity() + nodeCell.capacity() + path.capacity()
+                + corridorOf.capacity() + offset.capacity() + dist.capacity()) * sizeof(int)
+            + toA.capacity() + toB.capacity() + firstStep.capacity()
+            + corridors.capacity() * sizeof(Corridor);
+    }
+
+    // Graph of the built-in RAW_MAP, built on first use.
+    static const JunctionGraph& classic() {
+        static const JunctionGraph graph(Map(), 17, 11);
+        return graph;
+    }
+
+private:
+    // The ways out of cell c towards nodes: itself if it is one, else both
+    // ends of its corridor. Returns how many.
+    int endsOf(int c, End* out) const {
+        if (nodeOf[c] >= 0) {
+            out[0] = { nodeOf[c], 0, DIR_NONE };
+            return 1;
+        }
+        const Corridor& k = corridors[corridorOf[c]];
+        out[0] = { k.a, offset[c], toA[c] };
+        out[1] = { k.b, k.length - offset[c], toB[c] };
+        return 2;
+    }
+
+    int route(int from, int to, int& length) const {
+        return route(from, target(to), length);
+    }
+
+    int route(int from, const Target& t, int& length) const {
+        int to = t.id;
+        length = -1;
+        if (from < 0 || to < 0) return DIR_NONE;
+        length = 0;
+        if (from == to) return DIR_NONE;
+
+        const End* te = t.end;
+        int m = nodeCount();
+        int best, dir;
+        if (nodeOf[from] >= 0) {
+            // Leaving a node: into the target's corridor if this is its
+            // end, else the table's first step.
+            int u = nodeOf[from];
+            const int* du = &dist[(size_t)u * m];
+            best = 1 << 30;
+            dir = DIR_NONE;
+            for (int j = 0; j < t.ends; j++) {
+                int cost = du[te[j].node] + te[j].cost;
+                if (cost >= best) continue;
+                best = cost;
+                if (te[j].node != u) dir = firstStep[(size_t)u * m + te[j].node];
+                else {
+                    const Corridor& k = corridors[corridorOf[to]];
+                    dir = j == 0 ? k.exitA : k.exitB;
+                }
+            }
+        }
+        else {
+            // Inside a corridor: out by whichever end is closer, or straight
+            // along it if the target is in the same corridor.
+            const Corridor& k = corridors[corridorOf[from]];
+            const int* da = &dist[(size_t)k.a * m];
+            const int* db = &dist[(size_t)k.b * m];
+            int ca = offset[from], cb = k.length - offset[from];
+            int costA = ca + da[te[0].node] + te[0].cost, costB = cb + db[te[0].node] + te[0].cost;
+            if (t.ends == 2) {
+                costA = min(costA, ca + da[te[1].node] + te[1].cost);
+                costB = min(costB, cb + db[te[1].node] + te[1].cost);
+                if (corridorOf[to] == corridorOf[from]) {
+                    int straight = abs(offset[to] - offset[from]);
+                    if (straight <= costA && straight <= costB) {
+                        length = straight;
+                        return offset[to] < offset[from] ? toA[from] : toB[from];
+                    }
+                }
+            }
+            best = costA;
+            dir = toA[from];
+            if (costB < best) {
+                best = costB;
+                dir = toB[from];
+            }
+        }
+        length = best;
+        return dir;
+    }
+};
@@ -0,0 +1,319 @@
+// pacman_loadtest: plays many sessions at once against a pacman_server
+// and measures how late each tick's frame reaches the client (Linux only).
+//
+//   pacman_loadtest [--socket PATH] [--sessions N,N,...] [--seconds S] [--seed N]
+//   pacman_loadtest --check [GAMES] [--seed N]
+//
+// For each session count in turn it connects that many clients, lets them
+// play for --seconds and closes them again. Every client keeps a
+// GameMirror of its game from the frames, presses a random open direction
+// now and then, and records for every frame the time from the start of the
+// server's tick to the frame being read here. The report per step is the
+// delivered frame rate against what the tick rate asks for, latency
+// percentiles, and frames that arrived a whole tick late or did not fit the
+// game so far. The last line is the most sessions per server core that
+// still kept p99 latency within half a tick.
+//
+// The client reads every frame on one thread, so at the top end its own
+// reading is part of the latency; run it on a core the server is not using
+// when that matters.
+//
+// --check needs no server: it plays games here through the server's
+// FrameEncoder into a GameMirror and checks the mirror after every frame.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "Rng.h"
+#include "ServerProtocol.h"
+
+using namespace std;
+
+
+const int PRESS_EVERY = 4;      // frames between key presses, on average
+const int CHECK_TICKS = 20000;  // per --check game
+
+
+struct Client {
+    int fd = -1;
+    bool greeted = false;
+    ServerHello hello = {};
+    vector<uint8_t> in;
+    GameMirror mirror;
+};
+
+struct StepResult {
+    long long frames = 0, late = 0, mismatches = 0, disconnects = 0;
+    vector<uint32_t> latencyUs;
+};
+
+
+static int connectTo(const char* path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    // A full accept backlog refuses with EAGAIN; the server catches up.
+    for (int attempt = 0; attempt < 2000; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        int err = errno;
+        close(fd);
+        if (err != EAGAIN) return -1;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return -1;
+}
+
+// A random direction Pacman can move in from where the mirror has him,
+// DIR_NONE if none.
+static int randomPress(const GameMirror& m, Rng& rng) {
+    int x = m.pacX(), y = m.pacY();
+    if (x < 0 || x >= MAP_ROWS || y < 0 || y >= MAP_COLS) return DIR_NONE;
+    unsigned exits = m.getBoard().exits(x, y);
+    if (!exits) return DIR_NONE;
+    int k = (int)rng.below(popcount64(exits));
+    for (int d = DIR_LEFT; d <= DIR_UP; d++)
+        if ((exits & dirBit(d)) && k-- == 0) return d;
+    return DIR_NONE;
+}
+
+// Takes every whole message out of c.in. False if the connection should
+// be given up: a bad hello or a frame that does not parse.
+static bool readMessages(Client& c, uint64_t now, bool measure, StepResult& r, Rng& rng) {
+    size_t at = 0;
+    if (!c.greeted) {
+        if (c.in.size() < sizeof(ServerHello)) return true;
+        memcpy(&c.hello, c.in.data(), sizeof(ServerHello));
+        if (c.hello.magic != PROTOCOL_MAGIC || c.hello.version != PROTOCOL_VERSION) return false;
+        c.greeted = true;
+        at = sizeof(ServerHello);
+    }
+    while (c.in.size() - at >= sizeof(FrameHeader)) {
+        FrameHeader h;
+        memcpy(&h, c.in.data() + at, sizeof(h));
+        if (h.size < sizeof(h) || h.size > MAX_FRAME) return false;
+        if (c.in.size() - at < h.size) break;
+        if (!c.mirror.apply(c.in.data() + at, h.size)) r.mismatches++;
+        at += h.size;
+
+        if (measure) {
+            uint64_t us = now > h.tickNs ? (now - h.tickNs) / 1000 : 0;
+            r.latencyUs.push_back((uint32_t)min<uint64_t>(us, UINT32_MAX));
+            r.frames++;
+            if (us > c.hello.tickUs) r.late++;
+        }
+        if (!(h.flags & FRAME_PAUSED) && rng.below(PRESS_EVERY) == 0) {
+            uint8_t dir = (uint8_t)randomPress(c.mirror, rng);
+            if (dir != DIR_NONE && ::send(c.fd, &dir, 1, MSG_NOSIGNAL | MSG_DONTWAIT) < 0 && errno != EAGAIN)
+                return false;
+        }
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + at);
+    return true;
+}
+
+static uint32_t percentile(vector<uint32_t>& v, double q) {
+    if (v.empty()) return 0;
+    size_t i = (size_t)(q * (v.size() - 1) + 0.5);
+    nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+// One step of the ramp: `sessions` clients for `seconds`. Fills in the
+// server's shard count and tick period from the hello.
+static bool runStep(const char* path, int sessions, double seconds, uint64_t seed,
+    StepResult& r, int& shards, uint32_t& tickUs) {
+    vector<unique_ptr<Client>> clients;
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < sessions; i++) {
+        int fd = connectTo(path);
+        if (fd < 0) {
+            perror(path);
+            for (auto& c : clients) close(c->fd);
+            close(ep);
+            return false;
+        }
+        clients.emplace_back(new Client());
+        clients.back()->fd = fd;
+        epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = clients.back().get();
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    // Measured from a second after the last connect, once every session
+    // is being ticked.
+    Rng rng(seed);
+    uint64_t start = monotonicNs() + 1000000000ull;
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    vector<epoll_event> events(1024);
+    uint8_t buf[16384];
+    for (;;) {
+        uint64_t now = monotonicNs();
+        if (now >= end) break;
+        int n = epoll_wait(ep, events.data(), (int)events.size(), 50);
+        now = monotonicNs();
+        for (int i = 0; i < n; i++) {
+            Client& c = *(Client*)events[i].data.ptr;
+            if (c.fd < 0) continue;
+            ssize_t got = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+            bool ok = got > 0 || (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+            if (got > 0) {
+                c.in.insert(c.in.end(), buf, buf + got);
+                ok = readMessages(c, now, now >= start, r, rng);
+            }
+            if (!ok) {
+                r.disconnects++;
+                close(c.fd);
+                c.fd = -1;
+            }
+        }
+    }
+
+    for (auto& c : clients) {
+        if (c->greeted) {
+            shards = c->hello.shards;
+            tickUs = c->hello.tickUs;
+        }
+        if (c->fd >= 0) close(c->fd);
+    }
+    close(ep);
+    return true;
+}
+
+// --check: after every frame the mirror must hold the game's board, score
+// and Pacman's cell. Each game gets the extra life back whenever it has
+// used it, so it dies over and over; now and then a death falls on a tick
+// Pacman also eats, which sends him back to the start before the frame is
+// written. Fails if any frame is wrong or no such tick came up.
+static int runCheck(int games, uint64_t seed) {
+    long long frames = 0, deaths = 0, eatenDeaths = 0, wrong = 0;
+    uint8_t frame[MAX_FRAME];
+    SimSnapshot snap;
+    for (int g = 0; g < games; g++) {
+        Simulation sim(seed + g);
+        Rng rng(~(seed + g));
+        FrameEncoder encoder;
+        GameMirror mirror;
+        // Like the server, open with the ready pause's full frame.
+        mirror.apply(frame, encoder.encode(frame, 0, 0, sim, nullptr, 0));
+        for (uint32_t t = 1; t <= (uint32_t)CHECK_TICKS && !sim.isFinished(); t++) {
+            if (!sim.hasExtraLifeAvailable()) {
+                sim.save(snap);
+                snap.hasExtraLife = true;
+                sim.restore(snap);
+            }
+            int score = sim.getScore();
+            int input = rng.below(PRESS_EVERY) == 0 ? (int)rng.below(4) + 1 : DIR_NONE;
+            TickResult r = sim.step(input);
+            uint16_t size = encoder.encode(frame, t, 0, sim, &r, sim.getScore() - score);
+            frames++;
+            if (r.lostLife) {
+                deaths++;
+                if (r.ateDot || r.ateKey) eatenDeaths++;
+            }
+            const Pacman& pac = sim.getPacman();
+            if (!mirror.apply(frame, size) || mirror.getBoard().getHash() != sim.getMap().getHash()
+                || mirror.getScore() != sim.getScore()
+                || mirror.pacX() != pac.getGridX() || mirror.pacY() != pac.getGridY()) {
+                if (wrong++ == 0)
+                    printf("seed %llu tick %u: the mirror no longer matches the game\n",
+                        (unsigned long long)(seed + g), t);
+                break;
+            }
+        }
+    }
+    printf("check: %d games, %lld frames, %lld deaths, %lld of them on a tick Pacman ate, %lld wrong\n",
+        games, frames, deaths, eatenDeaths, wrong);
+    return wrong == 0 && eatenDeaths > 0 ? 0 : 1;
+}
+
+static void raiseFileLimit() {
+    rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+static void usage() {
+    printf("usage: pacman_loadtest [--socket PATH] [--sessions N,N,...] [--seconds S] [--seed N]\n");
+    printf("       pacman_loadtest --check [GAMES] [--seed N]\n");
+    printf("  --socket PATH       the server's socket (default %s)\n", DEFAULT_SERVER_SOCKET);
+    printf("  --sessions N,N,...  session counts to step through (default 100,500,1000,2000,4000,8000)\n");
+    printf("  --seconds S         measured time per step (default 5)\n");
+    printf("  --seed N            for the clients' key presses\n");
+    printf("  --check [GAMES]     no server: check GAMES locally encoded games frame by frame (default 100)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* path = DEFAULT_SERVER_SOCKET;
+    vector<int> steps = { 100, 500, 1000, 2000, 4000, 8000 };
+    double seconds = 5;
+    uint64_t seed = 1;
+    int checkGames = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) path = argv[++i];
+        else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+            steps.clear();
+            for (char* p = argv[++i]; *p;) {
+                int n = (int)strtol(p, &p, 10);
+                if (n > 0) steps.push_back(n);
+                if (*p) p++;
+            }
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--check") == 0) {
+            checkGames = 100;
+            if (i + 1 < argc && argv[i + 1][0] != '-') checkGames = atoi(argv[++i]);
+        }
+        else {
+            usage();
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    if (checkGames > 0) return runCheck(checkGames, seed);
+    raiseFileLimit();
+
+    printf("%8s %6s %11s %11s %9s %9s %9s %9s %7s %7s %5s\n", "sessions", "/shard", "frames/s",
+        "expected/s", "p50", "p95", "p99", "max", "late", "wrong", "lost");
+    int best = 0, shards = 1;
+    uint32_t tickUs = 0;
+    for (int n : steps) {
+        StepResult r;
+        if (!runStep(path, n, seconds, seed + (uint64_t)n, r, shards, tickUs)) return 1;
+        if (tickUs == 0) {
+            fprintf(stderr, "no hello from the server\n");
+            return 1;
+        }
+        double expected = n * 1e6 / tickUs;
+        uint32_t p99 = percentile(r.latencyUs, 0.99);
+        printf("%8d %6.0f %11.0f %11.0f %7.2fms %7.2fms %7.2fms %7.2fms %7lld %7lld %5lld\n", n,
+            (double)n / max(1, shards), r.frames / seconds, expected,
+            percentile(r.latencyUs, 0.5) / 1000.0, percentile(r.latencyUs, 0.95) / 1000.0, p99 / 1000.0,
+            percentile(r.latencyUs, 1.0) / 1000.0, r.late, r.mismatches, r.disconnects);
+        fflush(stdout);
+        if (p99 <= tickUs / 2 && r.disconnects == 0 && r.frames >= 0.95 * expected * seconds) best = n;
+    }
+    printf("  latency: server tick start to frame read here; late: over one %.1f ms tick; wrong: frames\n"
+        "  that did not fit the mirrored game; lost: sessions dropped\n", tickUs / 1000.0);
+    if (best > 0)
+        printf("  %d sessions per core (%d over %d shard(s)) with p99 within half a tick\n",
+            best / max(1, shards), best, shards);
+    else
+        printf("  no step kept p99 within half a tick\n");
+    return 0;
+}
@@ -0,0 +1,304 @@
+#pragma once
+// The maze: tile codes, the built-in layout and the mutable per-game grid.
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The layout, level boards and Zobrist keys are inline constexpr tables
+// built at compile time. MSVC only reports the real standard in _MSVC_LANG.
+#if defined(_MSVC_LANG) ? _MSVC_LANG < 201703L : __cplusplus < 201703L
+#error "Pac-Man needs C++17: set LanguageStandard to stdcpp17, or -std=c++17"
+#endif
+
+const int CELL_SIZE = 20;
+const char WALL = '1';
+const char DOT = '2';
+const char EMPTY = '0';
+const char KEY = '3';
+
+// Movement intents, as stored in Pacman::intent.
+const int DIR_NONE = 0;
+const int DIR_LEFT = 1;
+const int DIR_DOWN = 2;
+const int DIR_RIGHT = 3;
+const int DIR_UP = 4;
+
+constexpr char RAW_MAP[24][24] = {
+    "11111111111111111111111",
+    "12222222222122222222221",
+    "12111211112121111211121",
+    "12111211112121111211121",
+    "12222222222222222222221",
+    "12111212111111121211121",
+    "12222212222122221222221",
+    "11111211110101111211111",
+    "11111210000000001211111",
+    "11111210111011101211111",
+    "00000000111011100000000",
+    "11111210111011101211111",
+    "11111210111111101211111",
+    "11111210000000001211111",
+    "11111210111111101211111",
+    "12222222222122222222221",
+    "12111211112121111211121",
+    "12221222222022222212221",
+    "11121212111111121212111",
+    "12222212222122221222221",
+    "12111111112121111111121",
+    "12222222222222222222221",
+    "11111111111111111111111"
+};
+
+
+// Bit helpers for the 24x24 = 576-cell boards below, nine 64-bit words
+// per layer. Cells are numbered i * 24 + j, so j = -1 and j = 24 land on
+// the neighbouring row exactly like the old char grid[24][24] did.
+const int MAP_ROWS = 24;
+const int MAP_COLS = 24;
+const int MAP_CELLS = MAP_ROWS * MAP_COLS;
+const int MAP_WORDS = MAP_CELLS / 64;
+
+inline int popcount64(uint64_t v) {
+#ifdef _MSC_VER
+    return (int)__popcnt64(v);
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+// Index of the lowest set bit; v must not be 0.
+inline int ctz32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return (int)i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+constexpr int cellIndex(int i, int j) { return i * MAP_COLS + j; }
+
+constexpr bool testBit(const uint64_t* b, int c) { return (b[c >> 6] >> (c & 63)) & 1; }
+constexpr void setBit(uint64_t* b, int c) { b[c >> 6] |= 1ull << (c & 63); }
+constexpr void clearBit(uint64_t* b, int c) { b[c >> 6] &= ~(1ull << (c & 63)); }
+
+// Bit of `dir` in an exits mask.
+constexpr unsigned char dirBit(int dir) { return (unsigned char)(1 << (dir - 1)); }
+
+// Cells an actor can stand on, for anything indexed by position. Columns
+// run from -1 to MAP_COLS, since an actor can stand one cell past a tunnel
+// mouth for a tick; everything else off the board is ACTOR_CELLS.
+const int ACTOR_STRIDE = MAP_COLS + 2;
+const int ACTOR_CELLS = MAP_ROWS * ACTOR_STRIDE;
+
+inline int actorCell(int x, int y) {
+    if (x < 0 || x >= MAP_ROWS || y < -1 || y > MAP_COLS) return ACTOR_CELLS;
+    return x * ACTOR_STRIDE + y + 1;
+}
+
+
+// Random 64-bit keys for Zobrist hashing a game position: the hash is the
+// XOR of the keys of everything in it, so a change to one piece is two
+// XORs, one out and one in. Made at compile time, the same every run.
+struct ZobristKeys {
+    static const int ACTORS = 4;    // Pacman, then one per GhostKind
+    static const int LEVELS = 4;
+    static const int GHOSTS = 8;            // by spawn index
+    static const int RELEASE_TICKS = 32;    // last slot: further off than that
+
+    uint64_t dot[MAP_CELLS] = {};
+    uint64_t key[MAP_CELLS] = {};
+    uint64_t actor[ACTORS][ACTOR_CELLS + 1] = {};
+    uint64_t level[LEVELS] = {};
+    uint64_t extraLife = 0;
+    uint64_t heading[GHOSTS][5] = {};                   // by DIR_*
+    uint64_t release[GHOSTS][RELEASE_TICKS + 1] = {};   // ticks until due
+
+    constexpr ZobristKeys() {
+        uint64_t s = 0x5A0B1C7E2D3F4861ull;
+        auto next = [&s]() {    // SplitMix64
+            uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        };
+        for (uint64_t& k : dot) k = next();
+        for (uint64_t& k : key) k = next();
+        for (auto& a : actor)
+            for (uint64_t& k : a) k = next();
+        for (uint64_t& k : level) k = next();
+        extraLife = next();
+        for (auto& g : heading)
+            for (uint64_t& k : g) k = next();
+        for (auto& g : release)
+            for (uint64_t& k : g) k = next();
+    }
+};
+
+inline constexpr ZobristKeys ZOBRIST{};
+
+
+// Everything about a maze that never changes during a game: the wall
+// layer, the starting dots, for every cell a 4-bit mask of the directions
+// that are not walls, and which rows are side tunnels. Shared by all Maps
+// built from it. Built at compile time for RAW_MAP (see classic()), at
+// run time for maze files.
+struct MapLayout {
+    uint64_t walls[MAP_WORDS] = {};
+    uint64_t dots[MAP_WORDS] = {};
+    unsigned char exits[MAP_CELLS] = {};
+    int width = 0, height = 0;  // of the rows as written, before '\0' padding
+    int dotCount = 0;
+    uint32_t tunnels = 0;       // bit i: row i is open at both ends and wraps
+    uint64_t dotsHash = 0;      // ZobristKeys of the starting dots
+
+    constexpr explicit MapLayout(const char (*rows)[MAP_COLS]) {
+        for (int i = 0; i < MAP_ROWS; i++)
+            for (int j = 0; j < MAP_COLS; j++) {
+                int c = cellIndex(i, j);
+                if (rows[i][j] == WALL) setBit(walls, c);
+                else if (rows[i][j] == DOT) {
+                    setBit(dots, c);
+                    dotsHash ^= ZOBRIST.dot[c];
+                    dotCount++;
+                }
+                if (rows[i][j]) {
+                    if (j + 1 > width) width = j + 1;
+                    height = i + 1;
+                }
+            }
+
+        for (int i = 0; i < height; i++)
+            if (width > 1 && rows[i][0] && rows[i][0] != WALL && rows[i][width - 1] != WALL)
+                tunnels |= 1u << i;
+
+        // Anything beyond the board counts as wall.
+        for (int c = 0; c < MAP_CELLS; c++) {
+            auto open = [this](int n) { return n >= 0 && n < MAP_CELLS && !testBit(walls, n); };
+            if (open(c - 1))        exits[c] |= dirBit(DIR_LEFT);
+            if (open(c + MAP_COLS)) exits[c] |= dirBit(DIR_DOWN);
+            if (open(c + 1))        exits[c] |= dirBit(DIR_RIGHT);
+            if (open(c - MAP_COLS)) exits[c] |= dirBit(DIR_UP);
+        }
+    }
+
+    constexpr bool isOpen(int i, int j) const {
+        return i >= 0 && i < MAP_ROWS && j >= 0 && j < MAP_COLS && !testBit(walls, cellIndex(i, j));
+    }
+
+    // Cells reachable from (i, j) without crossing a wall, wrapping at the
+    // left and right edges like PathTable, as a bit layer.
+    struct Reach {
+        uint64_t bits[MAP_WORDS] = {};
+        constexpr bool has(int i, int j) const {
+            return i >= 0 && i < MAP_ROWS && j >= 0 && j < MAP_COLS && testBit(bits, cellIndex(i, j));
+        }
+    };
+
+    constexpr Reach reachFrom(int i, int j) const {
+        Reach r;
+        if (!isOpen(i, j)) return r;
+        short queue[MAP_CELLS] = {};
+        int head = 0, tail = 0;
+        setBit(r.bits, cellIndex(i, j));
+        queue[tail++] = (short)cellIndex(i, j);
+        while (head < tail) {
+            int c = queue[head++], ci = c / MAP_COLS, cj = c % MAP_COLS;
+            const int di[4] = { 0, 1, 0, -1 }, dj[4] = { -1, 0, 1, 0 };
+            for (int d = 0; d < 4; d++) {
+                int ni = ci + di[d], nj = (cj + dj[d] + MAP_COLS) % MAP_COLS;
+                if (!isOpen(ni, nj) || r.has(ni, nj)) continue;
+                setBit(r.bits, cellIndex(ni, nj));
+                queue[tail++] = (short)cellIndex(ni, nj);
+            }
+        }
+        return r;
+    }
+
+    // Whether every starting dot can be reached from (i, j).
+    constexpr bool dotsReachableFrom(int i, int j) const {
+        Reach r = reachFrom(i, j);
+        for (int w = 0; w < MAP_WORDS; w++)
+            if (dots[w] & ~r.bits[w]) return false;
+        return true;
+    }
+
+    static constexpr const MapLayout& classic();
+};
+
+inline constexpr MapLayout CLASSIC_LAYOUT(RAW_MAP);
+
+constexpr const MapLayout& MapLayout::classic() { return CLASSIC_LAYOUT; }
+
+static_assert(CLASSIC_LAYOUT.dotCount > 0, "RAW_MAP has no dots");
+static_assert(CLASSIC_LAYOUT.tunnels != 0, "RAW_MAP has no side tunnel");
+
+
+// The per-game board: a pointer to its layout, the dot and key layers and
+// their Zobrist hash, 160 bytes in all, so copying a Map is a handful of
+// vector stores. Walls live in the layout and cannot be set.
+class Map {
+    const MapLayout* layout;
+    uint64_t dots[MAP_WORDS] = {};
+    uint64_t keys[MAP_WORDS] = {};
+    uint64_t hash;
+public:
+    constexpr explicit Map(const MapLayout& l = MapLayout::classic()) : layout(&l), hash(l.dotsHash) {
+        for (int w = 0; w < MAP_WORDS; w++) dots[w] = l.dots[w];
+    }
+
+    char get(int i, int j) const {
+        int c = cellIndex(i, j);
+        if (testBit(layout->walls, c)) return WALL;
+        if (testBit(dots, c)) return DOT;
+        if (testBit(keys, c)) return KEY;
+        return EMPTY;
+    }
+
+    constexpr void set(int i, int j, char v) {
+        const ZobristKeys& z = ZOBRIST;
+        int c = cellIndex(i, j);
+        if (testBit(dots, c)) hash ^= z.dot[c];
+        if (testBit(keys, c)) hash ^= z.key[c];
+        clearBit(dots, c);
+        clearBit(keys, c);
+        if (v == DOT) { setBit(dots, c); hash ^= z.dot[c]; }
+        else if (v == KEY) { setBit(keys, c); hash ^= z.key[c]; }
+    }
+
+    bool isWall(int i, int j) const { return testBit(layout->walls, cellIndex(i, j)); }
+
+    // Walking off either side of a tunnel row comes back on the other.
+    bool isTunnelRow(int i) const { return i >= 0 && i < MAP_ROWS && ((layout->tunnels >> i) & 1); }
+
+    // DIR_* bits (see dirBit) of the neighbours of (i, j) that are not walls.
+    // None off the board, where a random ghost can stray through the padding.
+    unsigned char exits(int i, int j) const {
+        if ((unsigned)i >= (unsigned)MAP_ROWS || (unsigned)j >= (unsigned)MAP_COLS) return 0;
+        return layout->exits[cellIndex(i, j)];
+    }
+
+    int dotCount() const {
+        int n = 0;
+        for (int w = 0; w < MAP_WORDS; w++) n += popcount64(dots[w]);
+        return n;
+    }
+
+    int keyCount() const {
+        int n = 0;
+        for (int w = 0; w < MAP_WORDS; w++) n += popcount64(keys[w]);
+        return n;
+    }
+
+    // The dot and key layers as bitboards, bit c of word c / 64 for cellIndex c.
+    const uint64_t* dotBits() const { return dots; }
+    const uint64_t* keyBits() const { return keys; }
+
+    // Zobrist hash of the dots and keys, kept up to date by set().
+    uint64_t getHash() const { return hash; }
+
+    const MapLayout& getLayout() const { return *layout; }
+};
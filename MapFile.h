@@ -0,0 +1,87 @@
+#pragma once
+// Maze files in the format of assets/maps/classic/matriz.txt: the rows of
+// a C char-array initialiser, one quoted string per row, anything outside
+// the quotes ignored. A file with no quotes at all is read as one row per
+// non-empty line. Cells use the tile codes of Map.h.
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Map.h"
+
+using namespace std;
+
+
+// Reads and checks a maze file into `rows`, which is zero-filled first so
+// short rows are padded exactly like RAW_MAP. On failure `error` says what
+// is wrong and where.
+inline bool loadMapFile(const char* path, char rows[MAP_ROWS][MAP_COLS], string& error) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { error = string("cannot open ") + path; return false; }
+    string text;
+    char buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) text.append(buf, n);
+    fclose(f);
+
+    // Each row with the line it starts on, for messages.
+    vector<string> found;
+    vector<int> lines;
+    int line = 1;
+    bool quoted = text.find('"') != string::npos;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (quoted && text[i] == '"') {
+            size_t end = text.find('"', i + 1);
+            if (end == string::npos) {
+                error = "line " + to_string(line) + ": unterminated row";
+                return false;
+            }
+            found.push_back(text.substr(i + 1, end - i - 1));
+            lines.push_back(line);
+            i = end;
+        }
+        else if (!quoted && text[i] != '\n' && text[i] != '\r') {
+            size_t end = text.find_first_of("\r\n", i);
+            if (end == string::npos) end = text.size();
+            found.push_back(text.substr(i, end - i));
+            lines.push_back(line);
+            i = end - 1;
+        }
+        else if (text[i] == '\n') line++;
+    }
+
+    if (found.empty()) { error = "no rows"; return false; }
+    if ((int)found.size() > MAP_ROWS) {
+        error = to_string(found.size()) + " rows, at most " + to_string(MAP_ROWS) + " fit";
+        return false;
+    }
+    size_t width = found[0].size();
+    bool anyOpen = false;
+    for (size_t r = 0; r < found.size(); r++) {
+        const string& row = found[r];
+        string where = "line " + to_string(lines[r]) + ": ";
+        if (row.size() != width) {
+            error = where + "row is " + to_string(row.size()) + " cells wide, the first is "
+                + to_string(width);
+            return false;
+        }
+        if ((int)width > MAP_COLS) {
+            error = where + "row is " + to_string(width) + " cells wide, at most "
+                + to_string(MAP_COLS) + " fit";
+            return false;
+        }
+        for (size_t c = 0; c < row.size(); c++) {
+            char t = row[c];
+            if (t != WALL && t != DOT && t != EMPTY && t != KEY) {
+                error = where + "unknown tile '" + string(1, t) + "' in column " + to_string(c);
+                return false;
+            }
+            anyOpen |= t != WALL;
+        }
+    }
+    if (!anyOpen) { error = "every cell is a wall"; return false; }
+
+    memset(rows, 0, MAP_ROWS * MAP_COLS);
+    for (size_t r = 0; r < found.size(); r++)
+        memcpy(rows[r], found[r].data(), width);
+    return true;
+}
@@ -0,0 +1,630 @@
+// Microbenchmarks of the game loop's hot paths, each run in isolation on
+// fixed inputs, with the results written as JSON so two builds can be
+// compared:
+//
+//   pacman_bench --out base.json            (on the old commit)
+//   pacman_bench --compare base.json        (on the new one)
+//
+// Every benchmark is timed in several samples of a calibrated number of
+// operations; the JSON keeps the median and the fastest sample per
+// operation. The redraw benchmark needs Allegro and the assets directory and
+// is only built when CMake finds Allegro (PACMAN_BENCH_ALLEGRO).
+//
+// --alloc-report counts the heap allocations the simulation makes instead;
+// the counting operator new lives here so the game itself allocates
+// through the ordinary one.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "Batch.h"
+#include "JunctionGraph.h"
+#include "PathTable.h"
+#include "Sim.h"
+#include "Snapshot.h"
+#include "VecEnv.h"
+
+#ifdef PACMAN_BENCH_ALLEGRO
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_image.h>
+#endif
+
+using namespace std;
+
+
+// Every operator new in the process; see --alloc-report. The array and
+// nothrow forms forward to these. GCC's -Wmismatched-new-delete takes the
+// malloc and free inside them for a mismatch; here they are the pair.
+static atomic<long long> heapAllocs{ 0 };
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t n) {
+    heapAllocs.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+
+// Keeps the compiler from dropping a result it can see is unused.
+template <class T> inline void keep(const T& v) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&v) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &v;
+#endif
+}
+
+struct BenchResult {
+    string name;
+    long long iterations = 0;   // operations per sample
+    int samples = 0;
+    double nsPerOp = 0;         // median sample
+    double minNsPerOp = 0;      // fastest sample
+};
+
+struct BenchOptions {
+    double seconds = 0.5;       // total per benchmark, split over the samples
+    int samples = 7;
+    const char* filter = nullptr;
+};
+
+// A benchmark body runs `n` operations of whatever it measures. Any setup
+// belongs outside it, in state the body captures, since it runs many times.
+typedef function<void(long long n)> BenchBody;
+
+static double secondsOf(const BenchBody& body, long long n) {
+    auto t0 = chrono::steady_clock::now();
+    body(n);
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+static BenchResult measure(const char* name, const BenchBody& body, const BenchOptions& opts) {
+    BenchResult r;
+    r.name = name;
+    r.samples = opts.samples;
+
+    // Double the count until one sample takes its share of the time.
+    double target = opts.seconds / opts.samples;
+    long long n = 1;
+    double t = secondsOf(body, n);
+    while (t < target && n < (1ll << 40)) {
+        n = t > target / 64 ? (long long)(n * target / t) + 1 : n * 8;
+        t = secondsOf(body, n);
+    }
+    r.iterations = n;
+
+    vector<double> ns(opts.samples);
+    for (int s = 0; s < opts.samples; s++) ns[s] = secondsOf(body, n) * 1e9 / n;
+    sort(ns.begin(), ns.end());
+    r.nsPerOp = ns[ns.size() / 2];
+    r.minNsPerOp = ns[0];
+    return r;
+}
+
+
+// Ghosts of one kind spread over the maze and released, chasing a Pacman
+// who jumps to a random cell every 8 ticks, as in --stress.
+struct GhostField {
+    const JunctionGraph& graph = JunctionGraph::classic();
+    Map map;
+    GhostSet ghosts;
+    Rng rng;
+    int pacX = PAC_START_X, pacY = PAC_START_Y;
+    int fromX = PAC_START_X, fromY = PAC_START_Y;
+    long long tick = 0;
+
+    GhostField(int kind, int n, uint64_t seed) : rng(seed) {
+        for (int k = 0; k < GHOST_KIND_COUNT; k++)
+            if (kind < 0 || k == kind) ghosts.reserve(k, n);
+        for (int i = 0; i < n; i++) {
+            int c = (int)rng.below(graph.cellCount());
+            int spawn = ghosts.add(kind < 0 ? i % GHOST_KIND_COUNT : kind,
+                graph.cellRow(c), graph.cellCol(c), i % GHOST_SPRITE_COUNT, 0);
+            ghosts.release(spawn);
+        }
+    }
+
+    void movePacman() {
+        if (tick++ % 8 == 0) {
+            int c = (int)rng.below(graph.cellCount());
+            pacX = graph.cellRow(c);
+            pacY = graph.cellCol(c);
+        }
+        fromX = pacX;
+        fromY = pacY;
+        for (int tries = 0; tries < 4; tries++) {
+            int nx = fromX, ny = fromY;
+            PathTable::applyDir(nx, ny, DIR_LEFT + (int)rng.below(4));
+            if (graph.idOf(nx, ny) >= 0) { pacX = nx; pacY = ny; break; }
+        }
+    }
+
+    void step() {
+        movePacman();
+        ghosts.move(map, pacX, pacY, rng, graph);
+    }
+};
+
+// Collision queries against a field frozen after some ticks, cycling
+// through a fixed list of Pacman moves so every query does the same work
+// in every build.
+struct HitQueries {
+    static const int COUNT = 256;
+    int fromX[COUNT], fromY[COUNT], toX[COUNT], toY[COUNT];
+
+    explicit HitQueries(GhostField& f) {
+        for (int i = 0; i < COUNT; i++) {
+            f.movePacman();
+            fromX[i] = f.fromX; fromY[i] = f.fromY;
+            toX[i] = f.pacX; toY[i] = f.pacY;
+        }
+    }
+};
+
+
+#ifdef PACMAN_BENCH_ALLEGRO
+// Everything the front end draws in a frame, drawn from scratch into a
+// memory bitmap: the maze, every dot, Pacman, the ghosts and the HUD line.
+// This is the cost of a frame with no retained board layer and no GPU.
+class RedrawBench {
+    ALLEGRO_BITMAP* target = nullptr;
+    ALLEGRO_BITMAP* maze = nullptr;
+    ALLEGRO_BITMAP* dot = nullptr;
+    ALLEGRO_BITMAP* key = nullptr;
+    ALLEGRO_BITMAP* pac = nullptr;
+    ALLEGRO_BITMAP* ghost[GHOST_SPRITE_COUNT] = {};
+    ALLEGRO_FONT* font = nullptr;
+    bool ready = false;
+
+public:
+    RedrawBench() {
+        if (!al_init() || !al_init_image_addon() || !al_init_font_addon()) return;
+        al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+        const char* ghostFiles[GHOST_SPRITE_COUNT] = {
+            "assets/characters/ghosts/amarelo.png", "assets/characters/ghosts/azul.png",
+            "assets/characters/ghosts/blinky.png", "assets/characters/ghosts/gburro1.png",
+            "assets/characters/ghosts/rosa.png",
+        };
+        maze = al_load_bitmap("assets/maps/map.bmp");
+        dot = al_load_bitmap("assets/maps/bolas.png");
+        key = al_load_bitmap("assets/maps/key.png");
+        pac = al_load_bitmap("assets/characters/pacman/pacman.png");
+        ready = maze && dot && key && pac;
+        for (int i = 0; i < GHOST_SPRITE_COUNT; i++) {
+            ghost[i] = al_load_bitmap(ghostFiles[i]);
+            ready = ready && ghost[i];
+        }
+        font = al_create_builtin_font();
+        target = al_create_bitmap(MAP_COLS * CELL_SIZE, MAP_ROWS * CELL_SIZE + 40);
+        ready = ready && font && target;
+    }
+
+    bool isReady() const { return ready; }
+
+    void draw(const Simulation& sim) {
+        al_set_target_bitmap(target);
+        al_clear_to_color(al_map_rgb(0, 0, 0));
+        al_hold_bitmap_drawing(true);
+        al_draw_bitmap(maze, 0, 0, 0);
+        const Map& map = sim.getMap();
+        for (int i = 0; i < MAP_ROWS; i++)
+            for (int j = 0; j < MAP_COLS; j++) {
+                char c = map.get(i, j);
+                if (c == DOT) al_draw_bitmap(dot, j * CELL_SIZE, i * CELL_SIZE, 0);
+                else if (c == KEY) al_draw_bitmap(key, j * CELL_SIZE, i * CELL_SIZE, 0);
+            }
+        const Pacman& p = sim.getPacman();
+        al_draw_bitmap(pac, p.getPosX(), p.getPosY(), 0);
+        const GhostSet& ghosts = sim.getGhosts();
+        for (int i = 0; i < ghosts.size(); i++) {
+            GhostView g = ghosts.get(i);
+            al_draw_bitmap(ghost[g.getSprite()], g.getPosX(), g.getPosY(), 0);
+        }
+        al_hold_bitmap_drawing(false);
+        al_draw_textf(font, al_map_rgb(255, 255, 255), 10, MAP_ROWS * CELL_SIZE + 10, 0,
+            "Score: %d  Level: %d", sim.getScore(), sim.getLevel());
+    }
+};
+#endif
+
+
+static void addBenchmarks(vector<pair<string, BenchBody>>& benches, uint64_t seed) {
+    auto add = [&](const char* name, BenchBody body) { benches.push_back({ name, body }); };
+
+    // Map::get over every cell in turn, walls and padding included.
+    add("map_get", [](long long n) {
+        static Map map;
+        int acc = 0;
+        for (long long k = 0; k < n;) {
+            for (int c = 0; c < MAP_CELLS && k < n; c++, k++) acc += map.get(c / MAP_COLS, c % MAP_COLS);
+        }
+        keep(acc);
+        });
+
+    // Map::set eating and refilling the first dot row, which keeps the dot
+    // bitboard and counters changing like in play.
+    add("map_set", [](long long n) {
+        static Map map;
+        for (long long k = 0; k < n; k++) {
+            int j = 1 + (int)(k % (MAP_COLS - 2));
+            map.set(1, j, (k / (MAP_COLS - 2)) % 2 ? DOT : EMPTY);
+        }
+        keep(map);
+        });
+
+    add("map_dot_count", [](long long n) {
+        static Map map;
+        int acc = 0;
+        for (long long k = 0; k < n; k++) {
+            acc += map.dotCount();
+            keep(acc);
+        }
+        });
+
+    // Pacman::update with a new random intent every 8 ticks; the board is
+    // refilled once it has been walked for a while so there is still
+    // something to eat.
+    struct PacField {
+        Map map;
+        Pacman pac{ PAC_START_X, PAC_START_Y };
+        Rng rng;
+        long long tick = 0;
+        explicit PacField(uint64_t s) : rng(s) {}
+    };
+    auto pf = make_shared<PacField>(seed);
+    add("pacman_update", [pf](long long n) {
+        for (long long k = 0; k < n; k++, pf->tick++) {
+            if (pf->tick % 8 == 0) pf->pac.handleKey((int)pf->rng.below(4) + 1);
+            if (pf->tick % 4096 == 4095) pf->map = Map();
+            pf->pac.savePrev();
+            pf->pac.update(pf->map);
+        }
+        keep(pf->pac);
+        });
+
+    // GhostSet::move for each kind alone, per ghost moved: the game's own
+    // handful, and enough to fill every SIMD lane many times over.
+    static const int FIELD_SIZES[] = { 4, 256 };
+    for (int kind = 0; kind < GHOST_KIND_COUNT; kind++)
+        for (int size : FIELD_SIZES) {
+            char name[64];
+            snprintf(name, sizeof(name), "ghost_move_%s_%d", ghostKindName(kind), size);
+            auto f = make_shared<GhostField>(kind, size, seed);
+            add(name, [f, size](long long n) {
+                for (long long k = 0; k < n; k += size) f->step();
+                keep(f->ghosts);
+                });
+        }
+
+    // The swept collision check through the occupancy grid, and the SIMD
+    // scan it replaced, over the game's six ghosts and a crowd.
+    static const int HIT_SIZES[] = { 6, 1024 };
+    for (int size : HIT_SIZES) {
+        auto f = make_shared<GhostField>(-1, size, seed);
+        for (int t = 0; t < 64; t++) f->step();
+        auto q = make_shared<HitQueries>(*f);
+        for (int scan = 0; scan < 2; scan++) {
+            char name[64];
+            snprintf(name, sizeof(name), "collision_%s_%d", scan ? "scan" : "grid", size);
+            add(name, [f, q, scan](long long n) {
+                int acc = 0;
+                for (long long k = 0; k < n; k++) {
+                    int i = (int)(k % HitQueries::COUNT);
+                    acc += scan ? f->ghosts.scanHit(q->fromX[i], q->fromY[i], q->toX[i], q->toY[i])
+                        : f->ghosts.firstHit(q->fromX[i], q->fromY[i], q->toX[i], q->toY[i]);
+                }
+                keep(acc);
+                });
+        }
+    }
+
+    // Shortest-path first steps between random reachable cells, from the
+    // cell-pair table and from the junction graph.
+    auto pathRng = make_shared<Rng>(seed);
+    add("path_table_next_dir", [pathRng](long long n) {
+        const PathTable& paths = PathTable::classic();
+        int acc = 0;
+        for (long long k = 0; k < n; k++) {
+            int a = (int)pathRng->below(paths.cellCount()), b = (int)pathRng->below(paths.cellCount());
+            acc += paths.nextDir(paths.cellRow(a), paths.cellCol(a), paths.cellRow(b), paths.cellCol(b));
+        }
+        keep(acc);
+        });
+
+    auto graph = make_shared<JunctionGraph>(Map(), PAC_START_X, PAC_START_Y);
+    add("junction_graph_next_dir", [graph, pathRng](long long n) {
+        int acc = 0;
+        for (long long k = 0; k < n; k++) {
+            int a = (int)pathRng->below(graph->cellCount()), b = (int)pathRng->below(graph->cellCount());
+            acc += graph->nextDir(graph->cellRow(a), graph->cellCol(a), graph->cellRow(b), graph->cellCol(b));
+        }
+        keep(acc);
+        });
+
+    // One Simulation::step with the batch wander policy, games restarted
+    // as they end: the whole game loop minus the front end.
+    struct Game {
+        Simulation sim;
+        Rng inputRng;
+        uint64_t next;
+        explicit Game(uint64_t s) : sim(s), inputRng(~s), next(s) {}
+    };
+    auto game = make_shared<Game>(seed);
+    add("sim_step", [game](long long n) {
+        Simulation& sim = game->sim;
+        for (long long k = 0; k < n; k++) {
+            if (sim.isFinished()) sim.reset(++game->next);
+            sim.step(wanderPolicy(sim, game->inputRng));
+        }
+        keep(sim.getScore());
+        });
+
+    // VecEnv::step over a batch, per game stepped, observations included.
+    static const int ENV_SIZES[] = { 16, 1024 };
+    for (int size : ENV_SIZES) {
+        char name[64];
+        snprintf(name, sizeof(name), "vec_env_step_%d", size);
+        auto env = make_shared<VecEnv>(size);
+        auto actions = make_shared<vector<int>>(size, DIR_NONE);
+        auto envRng = make_shared<Rng>(seed);
+        add(name, [env, actions, envRng, size](long long n) {
+            for (long long k = 0; k < n; k += size) {
+                for (int g = 0; g < size; g++)
+                    (*actions)[g] = (env->getFrame(g) + g) % 8 == 0 ? (int)envRng->below(4) + 1 : DIR_NONE;
+                env->step(actions->data());
+            }
+            keep(env->getRewards()[0]);
+            });
+    }
+
+    // A game a few seconds in, for the snapshot and redraw benchmarks.
+    auto midGame = make_shared<Simulation>(seed);
+    for (int t = 0; t < 300 && !midGame->isFinished(); t++)
+        midGame->step(t % 8 == 0 ? DIR_LEFT + t / 8 % 4 : DIR_NONE);
+
+    auto ring = make_shared<SnapshotRing>(1024);
+    add("snapshot_save", [midGame, ring](long long n) {
+        for (long long k = 0; k < n; k++) ring->push(*midGame);
+        keep(*ring);
+        });
+
+    auto saved = make_shared<SimSnapshot>();
+    midGame->save(*saved);
+    auto restored = make_shared<Simulation>(seed);
+    add("snapshot_restore", [saved, restored](long long n) {
+        for (long long k = 0; k < n; k++) {
+            restored->restore(*saved);
+            keep(*restored);
+        }
+        });
+
+    // Zobrist key of a position, as AutoPlayer asks for at every node.
+    add("sim_hash", [midGame](long long n) {
+        uint64_t acc = 0;
+        for (long long k = 0; k < n; k++) {
+            acc += midGame->hash();
+            keep(acc);
+        }
+        });
+
+#ifdef PACMAN_BENCH_ALLEGRO
+    auto redraw = make_shared<RedrawBench>();
+    if (redraw->isReady())
+        add("redraw_memory_bitmap", [redraw, midGame](long long n) {
+            for (long long k = 0; k < n; k++) redraw->draw(*midGame);
+            });
+    else
+        fprintf(stderr, "redraw_memory_bitmap skipped: Allegro or the assets failed to load\n");
+#endif
+}
+
+
+static void writeJson(FILE* f, const vector<BenchResult>& results, const BenchOptions& opts, uint64_t seed) {
+    fprintf(f, "{\n  \"seed\": %llu,\n  \"samples\": %d,\n  \"seconds_per_benchmark\": %.3f,\n",
+        (unsigned long long)seed, opts.samples, opts.seconds);
+#ifdef NDEBUG
+    fprintf(f, "  \"build\": \"release\",\n");
+#else
+    fprintf(f, "  \"build\": \"debug\",\n");
+#endif
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f}%s\n",
+            r.name.c_str(), r.iterations, r.nsPerOp, r.minNsPerOp, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+// Reads back the name / ns_per_op pairs of a file writeJson() wrote. Not a
+// general JSON parser: it relies on one benchmark per line.
+static bool readJson(const char* path, vector<BenchResult>& out) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* ns = strstr(line, "\"ns_per_op\": ");
+        if (!name || !ns) continue;
+        name += 9;
+        const char* end = strchr(name, '"');
+        if (!end) continue;
+        BenchResult r;
+        r.name.assign(name, end);
+        r.nsPerOp = atof(ns + 13);
+        out.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+// Prints each benchmark against the same one in `base`; true if none got
+// slower by more than `tolerance` percent.
+static bool compareResults(const vector<BenchResult>& base, const vector<BenchResult>& now,
+    double tolerance)
+{
+    bool ok = true;
+    fprintf(stderr, "%-28s %12s %12s %9s\n", "benchmark", "base ns", "now ns", "change");
+    for (const BenchResult& r : now) {
+        const BenchResult* b = nullptr;
+        for (const BenchResult& c : base)
+            if (c.name == r.name) b = &c;
+        if (!b || b->nsPerOp <= 0) {
+            fprintf(stderr, "%-28s %12s %12.2f %9s\n", r.name.c_str(), "-", r.nsPerOp, "new");
+            continue;
+        }
+        double change = (r.nsPerOp / b->nsPerOp - 1) * 100;
+        bool slower = change > tolerance;
+        ok = ok && !slower;
+        fprintf(stderr, "%-28s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), b->nsPerOp, r.nsPerOp,
+            change, slower ? "  REGRESSION" : "");
+    }
+    return ok;
+}
+
+// Heap allocations made by the simulation, split by what the tick did.
+// After the first Simulation is built, level changes, deaths, resets and
+// plain ticks should all read zero. Played games hardly ever clear a level
+// or get caught holding the extra life, so each game is put there: at the
+// start of every level it is restored from a snapshot one point short of
+// the level's target, with the extra life in hand. Fails if anything
+// allocated, or if no level change or death came up.
+static int runAllocReport(int games, uint64_t seed) {
+    long long before = heapAllocs;
+    Simulation sim(seed);
+    long long startup = heapAllocs - before;
+
+    long long resets = 0, levelUps = 0, deaths = 0, ticks = 0;
+    long long resetAllocs = 0, levelAllocs = 0, deathAllocs = 0, tickAllocs = 0;
+    Rng inputRng(~seed);
+    SimSnapshot snap;
+    auto nearTarget = [&]() {
+        sim.save(snap);
+        int target = levelTarget(snap.currentLevel);
+        if (target > 0 && snap.score < target - 1) snap.score = target - 1;
+        snap.hasExtraLife = true;
+        sim.restore(snap);
+        };
+    for (int g = 0; g < games; g++) {
+        before = heapAllocs;
+        sim.reset(seed + g);
+        resetAllocs += heapAllocs - before;
+        resets++;
+        nearTarget();
+        while (!sim.isFinished() && sim.getFrameCount() < 100000) {
+            int input = (g & 1 ? dotPolicy : wanderPolicy)(sim, inputRng);
+            before = heapAllocs;
+            TickResult r = sim.step(input);
+            long long n = heapAllocs - before;
+            if (r.levelUp) { levelUps++; levelAllocs += n; nearTarget(); }
+            else if (r.lostLife) { deaths++; deathAllocs += n; }
+            else { ticks++; tickAllocs += n; }
+        }
+    }
+
+    printf("allocations: %lld to build the first Simulation\n", startup);
+    printf("  %-13s %9s %12s\n", "", "count", "allocations");
+    printf("  %-13s %9lld %12lld\n", "reset", resets, resetAllocs);
+    printf("  %-13s %9lld %12lld\n", "level change", levelUps, levelAllocs);
+    printf("  %-13s %9lld %12lld\n", "death", deaths, deathAllocs);
+    printf("  %-13s %9lld %12lld\n", "other tick", ticks, tickAllocs);
+    if (levelUps == 0 || deaths == 0) {
+        printf("no %s came up; nothing was measured there\n", levelUps == 0 ? "level change" : "death");
+        return 1;
+    }
+    return resetAllocs + levelAllocs + deathAllocs + tickAllocs == 0 ? 0 : 1;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: pacman_bench [options]\n"
+        "  --out FILE          write the JSON there instead of stdout\n"
+        "  --filter TEXT       only benchmarks whose name contains TEXT\n"
+        "  --seconds S         time per benchmark (default 0.5)\n"
+        "  --samples N         samples per benchmark, median reported (default 7)\n"
+        "  --quick             --seconds 0.05 --samples 3, for smoke runs\n"
+        "  --seed N            seed for the generated inputs (default 1)\n"
+        "  --compare FILE      compare with an earlier JSON; exit 1 on a regression\n"
+        "  --tolerance PCT     slowdown allowed by --compare (default 10)\n"
+        "  --list              print the benchmark names and exit\n"
+        "  --alloc-report [N]  count the simulation's heap allocations over N games (default 1000)\n");
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    const char* outPath = nullptr;
+    const char* comparePath = nullptr;
+    double tolerance = 10;
+    uint64_t seed = 1;
+    bool list = false;
+    int allocGames = 0;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasArg = i + 1 < argc;
+        if (strcmp(argv[i], "--out") == 0 && hasArg) outPath = argv[++i];
+        else if (strcmp(argv[i], "--filter") == 0 && hasArg) opts.filter = argv[++i];
+        else if (strcmp(argv[i], "--seconds") == 0 && hasArg) opts.seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--samples") == 0 && hasArg) opts.samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--quick") == 0) { opts.seconds = 0.05; opts.samples = 3; }
+        else if (strcmp(argv[i], "--seed") == 0 && hasArg) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--compare") == 0 && hasArg) comparePath = argv[++i];
+        else if (strcmp(argv[i], "--tolerance") == 0 && hasArg) tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "--list") == 0) list = true;
+        else if (strcmp(argv[i], "--alloc-report") == 0) {
+            allocGames = 1000;
+            if (hasArg && argv[i + 1][0] != '-') allocGames = atoi(argv[++i]);
+        }
+        else { usage(); return 2; }
+    }
+    if (allocGames > 0) return runAllocReport(allocGames, seed);
+    if (opts.samples < 1) opts.samples = 1;
+    if (opts.seconds <= 0) opts.seconds = 0.5;
+
+    vector<BenchResult> base;
+    if (comparePath && !readJson(comparePath, base)) {
+        fprintf(stderr, "cannot read %s\n", comparePath);
+        return 2;
+    }
+
+    vector<pair<string, BenchBody>> benches;
+    addBenchmarks(benches, seed);
+
+    vector<BenchResult> results;
+    for (const auto& b : benches) {
+        if (opts.filter && !strstr(b.first.c_str(), opts.filter)) continue;
+        if (list) { printf("%s\n", b.first.c_str()); continue; }
+        BenchResult r = measure(b.first.c_str(), b.second, opts);
+        fprintf(stderr, "%-28s %12.2f ns/op\n", r.name.c_str(), r.nsPerOp);
+        results.push_back(r);
+    }
+    if (list) return 0;
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", outPath);
+        return 2;
+    }
+    writeJson(out, results, opts, seed);
+    if (outPath) fclose(out);
+
+    if (comparePath && !compareResults(base, results, tolerance)) return 1;
+    return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+// Which ghosts stand on which cell, kept up to date as they move, so asking
+// who is on a cell costs the number of ghosts there instead of the number
+// of ghosts in the game. Each cell heads an intrusive doubly linked list of
+// spawn indices; moving a ghost is an unlink and a push, and nothing
+// allocates once reserve() has been called.
+//
+// Cells are actorCell()s, so columns run from -1 to MAP_COLS. Dice steps
+// do not wrap, so a random ghost can also wander into the '\0' padding
+// around the board; anything outside the grid shares one extra list that
+// no query looks at.
+#include <vector>
+#include "Map.h"
+
+using namespace std;
+
+
+class OccupancyGrid {
+    static const int CELLS = ACTOR_CELLS;
+
+    int head[CELLS + 1];
+    vector<int> next, prev;     // by spawn index, -1 at the ends of a list
+    vector<short> cell;         // by spawn index
+    vector<short> last;         // by spawn index: the cell before the latest move
+
+    static int cellOf(int x, int y) { return actorCell(x, y); }
+
+    void link(int id, int c) {
+        cell[id] = (short)c;
+        prev[id] = -1;
+        next[id] = head[c];
+        if (head[c] >= 0) prev[head[c]] = id;
+        head[c] = id;
+    }
+
+    void unlink(int id) {
+        int c = cell[id];
+        if (prev[id] >= 0) next[prev[id]] = next[id];
+        else head[c] = next[id];
+        if (next[id] >= 0) prev[next[id]] = prev[id];
+    }
+
+public:
+    OccupancyGrid() { clear(); }
+
+    void reserve(int n) {
+        next.reserve(n);
+        prev.reserve(n);
+        cell.reserve(n);
+        last.reserve(n);
+    }
+
+    void clear() {
+        for (int& h : head) h = -1;
+        next.clear();
+        prev.clear();
+        cell.clear();
+        last.clear();
+    }
+
+    // Places the next spawn index on (x, y); ids must be added in order.
+    void add(int x, int y) {
+        int id = (int)cell.size();
+        next.push_back(-1);
+        prev.push_back(-1);
+        cell.push_back(0);
+        last.push_back((short)cellOf(x, y));
+        link(id, cellOf(x, y));
+    }
+
+    // Records that ghost `id` stepped from (fromX, fromY) to (x, y) this
+    // tick. Cheap if it has not moved. Returns the cell it left, or -1 if
+    // it is still on the same one.
+    int move(int id, int fromX, int fromY, int x, int y) {
+        last[id] = (short)cellOf(fromX, fromY);
+        int c = cellOf(x, y), was = cell[id];
+        if (c == was) return -1;
+        unlink(id);
+        link(id, c);
+        return was;
+    }
+
+    // The actorCell() ghost `id` is on.
+    int cellOfGhost(int id) const { return cell[id]; }
+
+    // First ghost on (x, y), in no particular order, or -1; then nextAt()
+    // until -1 for the rest.
+    int firstAt(int x, int y) const {
+        int c = cellOf(x, y);
+        return c < CELLS ? head[c] : -1;
+    }
+    int nextAt(int id) const { return next[id]; }
+
+    // Whether ghost `id` started its latest move on (x, y).
+    bool cameFrom(int id, int x, int y) const {
+        int c = cellOf(x, y);
+        return c < CELLS && last[id] == c;
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+// All-pairs next-hop table, for the bots and AutoPlayer's evaluation; the
+// ghosts path on the smaller JunctionGraph. Built once per maze by one BFS
+// per walkable cell; afterwards "which way from A towards B" is one load.
+// The left and right edges wrap, which is how the row 10 tunnel works:
+// column -1 is column 23 and column 24 is column 0, as in teleportCheck().
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "Map.h"
+
+using namespace std;
+
+
+class PathTable {
+    static const int ROWS = 24, COLS = 24;
+
+    short cellId[ROWS][COLS];
+    vector<short> cellX, cellY;
+    vector<unsigned char> next;     // [from * cellCount + to] = DIR_* or DIR_NONE
+
+    static int wrapCol(int y) {
+        if (y < 0) return y + COLS;
+        if (y >= COLS) return y - COLS;
+        return y;
+    }
+
+public:
+    // Indexes every cell reachable from (startX, startY) without crossing a
+    // wall, then fills the table with one reverse BFS per target cell.
+    PathTable(const Map& map, int startX, int startY) {
+        memset(cellId, -1, sizeof(cellId));
+
+        cellId[startX][startY] = 0;
+        cellX.push_back((short)startX);
+        cellY.push_back((short)startY);
+        for (size_t head = 0; head < cellX.size(); head++) {
+            int x = cellX[head], y = cellY[head];
+            for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                int nx = x, ny = y;
+                applyDir(nx, ny, d);
+                if (nx < 0 || nx >= ROWS) continue;
+                if (cellId[nx][ny] >= 0 || map.isWall(nx, ny)) continue;
+                cellId[nx][ny] = (short)cellX.size();
+                cellX.push_back((short)nx);
+                cellY.push_back((short)ny);
+            }
+        }
+
+        int n = cellCount();
+        next.assign((size_t)n * n, (unsigned char)DIR_NONE);
+        vector<int> dist(n), queue(n);
+        for (int target = 0; target < n; target++) {
+            fill(dist.begin(), dist.end(), -1);
+            int head = 0, tail = 0;
+            dist[target] = 0;
+            queue[tail++] = target;
+            while (head < tail) {
+                int c = queue[head++];
+                for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+                    int nx = cellX[c], ny = cellY[c];
+                    applyDir(nx, ny, d);
+                    int nb = idOf(nx, ny);
+                    if (nb < 0 || dist[nb] >= 0) continue;
+                    dist[nb] = dist[c] + 1;
+                    queue[tail++] = nb;
+                    // The neighbour was reached from c, so its first step
+                    // towards the target is the opposite of d.
+                    next[(size_t)nb * n + target] = (unsigned char)opposite(d);
+                }
+            }
+        }
+    }
+
+    static int opposite(int dir) {
+        switch (dir) {
+        case DIR_LEFT:  return DIR_RIGHT;
+        case DIR_RIGHT: return DIR_LEFT;
+        case DIR_UP:    return DIR_DOWN;
+        case DIR_DOWN:  return DIR_UP;
+        default:        return DIR_NONE;
+        }
+    }
+
+    // Moves (x, y) one cell in `dir`, wrapping through the side tunnel.
+    static void applyDir(int& x, int& y, int dir) {
+        if (dir == DIR_UP) x--;
+        else if (dir == DIR_DOWN) x++;
+        else if (dir == DIR_LEFT) y = wrapCol(y - 1);
+        else if (dir == DIR_RIGHT) y = wrapCol(y + 1);
+    }
+
+    int cellCount() const { return (int)cellX.size(); }
+    int cellRow(int id) const { return cellX[id]; }
+    int cellCol(int id) const { return cellY[id]; }
+
+    // -1 for walls and anything outside the reachable maze.
+    int idOf(int x, int y) const {
+        if (x < 0 || x >= ROWS) return -1;
+        y = wrapCol(y);
+        if (y < 0 || y >= COLS) return -1;
+        return cellId[x][y];
+    }
+
+    // First step of a shortest path from one cell to another, or DIR_NONE if
+    // they are the same cell or either one is not part of the maze.
+    int nextDir(int fromX, int fromY, int toX, int toY) const {
+        int from = idOf(fromX, fromY), to = idOf(toX, toY);
+        if (from < 0 || to < 0) return DIR_NONE;
+        return next[(size_t)from * cellCount() + to];
+    }
+
+    // Same as nextDir() for cells already turned into ids with idOf().
+    int step(int from, int to) const { return next[(size_t)from * cellCount() + to]; }
+
+    size_t bytes() const {
+        return sizeof(*this) + next.capacity()
+            + (cellX.capacity() + cellY.capacity()) * sizeof(short);
+    }
+
+    // Table for the built-in RAW_MAP, built on first use.
+    static const PathTable& classic() {
+        static const PathTable table(Map(), 17, 11);
+        return table;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+// Small per-game random generator (xorshift64*). Each Simulation owns one,
+// so the same seed and the same inputs always replay the same game, and
+// games on different threads never share hidden state the way rand() does.
+#include <cstdint>
+
+
+class Rng {
+    uint64_t state;
+public:
+    explicit Rng(uint64_t seed = 1) { reseed(seed); }
+
+    // SplitMix64 scramble so that nearby seeds give unrelated streams and
+    // the xorshift state is never zero.
+    void reseed(uint64_t seed) {
+        uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        state = z ? z : 0x9E3779B97F4A7C15ull;
+    }
+
+    uint32_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (uint32_t)((state * 0x2545F4914F6CDD1Dull) >> 32);
+    }
+
+    // Uniform in [0, n) without a division.
+    uint32_t below(uint32_t n) {
+        return (uint32_t)(((uint64_t)next() * n) >> 32);
+    }
+
+    uint64_t getState() const { return state; }
+    void setState(uint64_t s) { state = s; }
+};
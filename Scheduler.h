@@ -0,0 +1,68 @@
+#pragma once
+// Fixed-capacity event scheduler: a binary min-heap of (time, event id)
+// in a plain array, so it never allocates and copies like any other POD.
+// Time is whatever unit the owner counts in: simulation ticks for ghost
+// releases, milliseconds for the front end's timed states. Events due at
+// the same time come out in the order they were scheduled.
+#include <cstdint>
+
+
+template <int CAPACITY>
+class Scheduler {
+    struct Entry {
+        uint64_t at;
+        uint32_t seq;
+        int event;
+    };
+
+    Entry heap[CAPACITY];
+    int count = 0;
+    uint32_t nextSeq = 0;
+
+    static bool before(const Entry& a, const Entry& b) {
+        return a.at < b.at || (a.at == b.at && a.seq < b.seq);
+    }
+
+public:
+    // False when the scheduler is full.
+    bool schedule(uint64_t at, int event) {
+        if (count == CAPACITY) return false;
+        int i = count++;
+        heap[i] = { at, nextSeq++, event };
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!before(heap[i], heap[parent])) break;
+            Entry t = heap[i]; heap[i] = heap[parent]; heap[parent] = t;
+            i = parent;
+        }
+        return true;
+    }
+
+    // Takes the earliest event if it is due at `now`.
+    bool popDue(uint64_t now, int& event) {
+        if (count == 0 || heap[0].at > now) return false;
+        event = heap[0].event;
+        heap[0] = heap[--count];
+        int i = 0;
+        for (;;) {
+            int l = 2 * i + 1, r = l + 1, m = i;
+            if (l < count && before(heap[l], heap[m])) m = l;
+            if (r < count && before(heap[r], heap[m])) m = r;
+            if (m == i) break;
+            Entry t = heap[i]; heap[i] = heap[m]; heap[m] = t;
+            i = m;
+        }
+        return true;
+    }
+
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+    uint64_t nextTime() const { return count ? heap[0].at : UINT64_MAX; }
+    void clear() { count = 0; }
+
+    // Calls f(at, event) for every pending event, in no particular order.
+    template <class F>
+    void forEach(F f) const {
+        for (int i = 0; i < count; i++) f(heap[i].at, heap[i].event);
+    }
+};
@@ -0,0 +1,221 @@
+#pragma once
+// Wire format between pacman_server and its clients. Both ends run on one
+// machine and talk over a Unix-domain stream socket, so every field is in
+// the host's byte order and layout.
+//
+// Client to server: one byte per key press, a DIR_* value.
+//
+// Server to client: a ServerHello when the session opens, then one frame
+// per tick of the session, paused ticks included:
+//
+//   FrameHeader
+//   FullState                      if FRAME_FULL
+//   ActorCell x header.actors      whoever changed cell this tick
+//   Eaten                          if FRAME_ATE
+//
+// A FRAME_FULL frame starts a level, or a new game: the board is
+// LEVEL_BOARDS[level] and every actor is listed. Every other frame only
+// carries what changed, so a client that applies them in order holds the
+// same board, cells and score as the server's game.
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include "Sim.h"
+
+using namespace std;
+
+
+const char* const DEFAULT_SERVER_SOCKET = "/tmp/pacman.sock";
+const uint32_t PROTOCOL_MAGIC = 0x53434150;     // "PACS"
+const uint16_t PROTOCOL_VERSION = 1;
+const int MAX_ACTORS = 1 + GHOST_SPAWN_COUNT;   // Pacman is actor 0, ghost i is actor 1 + i
+
+struct ServerHello {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t shards;        // simulation threads on the server
+    uint32_t tickUs;        // tick period
+    uint32_t session;
+};
+
+enum FrameFlag {
+    FRAME_FULL = 1,         // level or game starts; FullState follows
+    FRAME_ATE = 2,          // Pacman ate a dot or a key; Eaten follows
+    FRAME_PAUSED = 4,       // no step this tick: ready, level, death or end pause
+    FRAME_LIFE_LOST = 8,
+    FRAME_GAME_OVER = 16,
+    FRAME_WON = 32,
+    FRAME_EXTRA_LIFE = 64,  // state, not event: Pacman holds the extra life
+};
+
+struct FrameHeader {
+    uint16_t size;          // of the whole frame, this header included
+    uint8_t flags;
+    uint8_t actors;
+    uint32_t tick;          // of the session
+    uint64_t tickNs;        // monotonicNs() when the server's tick began
+};
+
+struct FullState {
+    int32_t score;
+    uint8_t level;
+    uint8_t ghosts;
+    uint16_t dots;
+};
+
+struct ActorCell {
+    uint8_t actor;
+    uint8_t unused;
+    uint16_t cell;          // actorCell(x, y)
+};
+
+struct Eaten {
+    uint16_t cell;          // cellIndex(x, y)
+    int16_t points;
+};
+
+const int MAX_FRAME = (int)(sizeof(FrameHeader) + sizeof(FullState)
+    + MAX_ACTORS * sizeof(ActorCell) + sizeof(Eaten));
+
+static_assert(sizeof(FrameHeader) == 16 && sizeof(FullState) == 8 && sizeof(ActorCell) == 4
+    && sizeof(Eaten) == 4, "wire structs must not be padded");
+static_assert(MAX_ACTORS <= 255, "actor ids are one byte");
+
+
+// CLOCK_MONOTONIC is one clock for every process on the machine, so a
+// client can subtract the server's tickNs from its own reading.
+inline uint64_t monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+// The server's side of one session's frames: remembers which cells the
+// client has seen, so each frame carries only what changed.
+class FrameEncoder {
+    uint16_t sent[MAX_ACTORS] = {};     // cells as the client last saw them
+    bool full = true;                   // the next frame starts a level
+
+public:
+    // The next frame starts over with a full state: a new game.
+    void restart() { full = true; }
+
+    // Writes the frame for `sim`'s latest tick into `frame`, which holds
+    // MAX_FRAME bytes, and returns its size. `r` is what the step did, or
+    // null for a paused tick; `points` is the score it added.
+    uint16_t encode(uint8_t* frame, uint32_t tick, uint64_t tickNs, const Simulation& sim,
+        const TickResult* r, int points) {
+        FrameHeader h = {};
+        h.tick = tick;
+        h.tickNs = tickNs;
+        Eaten eaten = {};
+
+        if (!r) h.flags |= FRAME_PAUSED;
+        else {
+            if (r->levelUp) full = true;
+            else if (r->ateDot || r->ateKey) {
+                // From step(), not Pacman: a death the same tick has
+                // already sent him back to the start.
+                h.flags |= FRAME_ATE;
+                eaten.cell = (uint16_t)cellIndex(r->eatenX, r->eatenY);
+                eaten.points = (int16_t)points;
+            }
+            if (r->lostLife) h.flags |= FRAME_LIFE_LOST;
+            if (r->gameOver) h.flags |= FRAME_GAME_OVER;
+            if (r->won) h.flags |= FRAME_WON;
+        }
+        if (sim.hasExtraLifeAvailable()) h.flags |= FRAME_EXTRA_LIFE;
+
+        uint8_t* p = frame + sizeof(h);
+        if (full) {
+            h.flags |= FRAME_FULL;
+            FullState f = { sim.getScore(), (uint8_t)sim.getLevel(),
+                (uint8_t)sim.getGhosts().size(), (uint16_t)sim.getBola() };
+            memcpy(p, &f, sizeof(f));
+            p += sizeof(f);
+        }
+        const Pacman& pac = sim.getPacman();
+        const GhostSet& ghosts = sim.getGhosts();
+        for (int a = 0; a <= ghosts.size(); a++) {
+            int cell = a == 0 ? actorCell(pac.getGridX(), pac.getGridY())
+                : actorCell(ghosts.get(a - 1).getGridX(), ghosts.get(a - 1).getGridY());
+            if (!full && sent[a] == cell) continue;
+            ActorCell c = { (uint8_t)a, 0, (uint16_t)cell };
+            memcpy(p, &c, sizeof(c));
+            p += sizeof(c);
+            sent[a] = (uint16_t)cell;
+            h.actors++;
+        }
+        if (h.flags & FRAME_ATE) {
+            memcpy(p, &eaten, sizeof(eaten));
+            p += sizeof(eaten);
+        }
+        full = false;
+        h.size = (uint16_t)(p - frame);
+        memcpy(frame, &h, sizeof(h));
+        return h.size;
+    }
+};
+
+
+// A client's copy of one game, kept by applying frames.
+class GameMirror {
+    Map board;
+    int score = 0, level = -1, ghosts = 0;
+    uint16_t cells[MAX_ACTORS] = {};
+
+public:
+    // False if the frame is malformed or does not fit the game so far: a
+    // delta before the first full frame, or something eaten off an empty
+    // cell.
+    bool apply(const uint8_t* frame, size_t size) {
+        FrameHeader h;
+        if (size < sizeof(h)) return false;
+        memcpy(&h, frame, sizeof(h));
+        size_t need = sizeof(h) + h.actors * sizeof(ActorCell)
+            + (h.flags & FRAME_FULL ? sizeof(FullState) : 0) + (h.flags & FRAME_ATE ? sizeof(Eaten) : 0);
+        if (h.size != size || size != need) return false;
+        const uint8_t* p = frame + sizeof(h);
+
+        if (h.flags & FRAME_FULL) {
+            FullState f;
+            memcpy(&f, p, sizeof(f));
+            p += sizeof(f);
+            if (f.level > LAST_LEVEL || f.ghosts >= MAX_ACTORS) return false;
+            level = f.level;
+            board = LEVEL_BOARDS[level].map;
+            score = f.score;
+            ghosts = f.ghosts;
+            if (f.dots != LEVEL_BOARDS[level].dots) return false;
+        }
+        if (level < 0) return false;
+
+        for (int k = 0; k < h.actors; k++) {
+            ActorCell a;
+            memcpy(&a, p, sizeof(a));
+            p += sizeof(a);
+            if (a.actor > ghosts || a.cell > ACTOR_CELLS) return false;
+            cells[a.actor] = a.cell;
+        }
+
+        if (h.flags & FRAME_ATE) {
+            Eaten e;
+            memcpy(&e, p, sizeof(e));
+            if (e.cell >= MAP_CELLS) return false;
+            int x = e.cell / MAP_COLS, y = e.cell % MAP_COLS;
+            char c = board.get(x, y);
+            if (c != DOT && c != KEY) return false;
+            board.set(x, y, EMPTY);
+            score += e.points;
+        }
+        return true;
+    }
+
+    const Map& getBoard() const { return board; }
+    int getScore() const { return score; }
+    int getLevel() const { return level; }
+    int getGhosts() const { return ghosts; }
+    int pacX() const { return cells[0] / ACTOR_STRIDE; }
+    int pacY() const { return cells[0] % ACTOR_STRIDE - 1; }
+};
@@ -0,0 +1,551 @@
+#pragma once
+// Headless simulation core: the game rules without any display, timer,
+// event queue or audio device. The Allegro front end feeds input into
+// Simulation::step() and draws whatever state it exposes.
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+#include "Ghosts.h"
+#include "JunctionGraph.h"
+#include "Map.h"
+#include "PathTable.h"
+#include "Profiler.h"
+#include "Rng.h"
+#include "Scheduler.h"
+
+using namespace std;
+
+
+const int TARGET_SCORE_LEVEL1 = 100;
+const int TARGET_SCORE_LEVEL2 = 175;
+const int TARGET_SCORE_LEVEL3 = 210;
+const int LAST_LEVEL = 3;
+
+// Score that moves a game on from `level`, or -1 on the last level, which
+// is won by clearing its dots instead.
+inline int levelTarget(int level) {
+    switch (level) {
+    case 1:  return TARGET_SCORE_LEVEL1;
+    case 2:  return TARGET_SCORE_LEVEL2;
+    default: return -1;
+    }
+}
+
+const int PAC_START_X = 17, PAC_START_Y = 11;
+
+// Sprite slot a ghost is drawn with; the front end owns the bitmaps.
+enum GhostSprite { GHOST_YELLOW, GHOST_BLUE, GHOST_RED, GHOST_GREEN, GHOST_PINK, GHOST_SPRITE_COUNT };
+
+
+// Every ghost of every level. A ghost is present from `level` on, in
+// table order, which is also its spawn index; `delay` is the tick of the
+// game at which it leaves the house.
+struct GhostSpawn {
+    int level, kind, x, y, sprite, delay;
+};
+
+constexpr GhostSpawn GHOST_SPAWNS[] = {
+    { 1, GHOST_RANDOM,  8, 11, GHOST_YELLOW,   0 },
+    { 1, GHOST_RANDOM,  9, 11, GHOST_BLUE,    70 },
+    { 1, GHOST_RANDOM, 10, 11, GHOST_RED,    140 },
+    { 1, GHOST_BLINKY, 11, 11, GHOST_GREEN,  210 },
+    { 2, GHOST_PINKY,   8,  9, GHOST_PINK,   280 },
+    { 3, GHOST_RANDOM,  7, 11, GHOST_YELLOW, 350 },
+};
+const int GHOST_SPAWN_COUNT = sizeof(GHOST_SPAWNS) / sizeof(GHOST_SPAWNS[0]);
+static_assert(GHOST_SPAWN_COUNT <= ZobristKeys::GHOSTS, "ZobristKeys needs a row per spawn");
+
+// Extra-life keys, placed at the start of exactly `level`.
+struct KeySpawn {
+    int level, x, y;
+};
+
+constexpr KeySpawn KEY_SPAWNS[] = {
+    { 2, 10, 11 },
+    { 3, 10,  5 },
+    { 3, 10, 17 },
+};
+
+// Puts `level`'s keys on a fresh board; false if it has none.
+constexpr bool placeKeys(Map& map, int level) {
+    bool any = false;
+    for (const KeySpawn& k : KEY_SPAWNS)
+        if (k.level == level) {
+            map.set(k.x, k.y, KEY);
+            any = true;
+        }
+    return any;
+}
+
+// What a level starts on: the classic board with the level's keys placed,
+// and its dot count. Made at compile time, so starting a level is a copy.
+struct LevelBoard {
+    Map map;
+    int dots;
+    bool keys;
+
+    constexpr explicit LevelBoard(int level) : map(), dots(CLASSIC_LAYOUT.dotCount), keys(false) {
+        keys = placeKeys(map, level);
+    }
+};
+
+// By level number; [0] is unused.
+inline constexpr LevelBoard LEVEL_BOARDS[LAST_LEVEL + 1] = {
+    LevelBoard(0), LevelBoard(1), LevelBoard(2), LevelBoard(3),
+};
+static_assert(LAST_LEVEL == 3, "LEVEL_BOARDS lists every level");
+
+
+// The classic maze and the spawn tables, checked at compile time: every
+// dot and key can be eaten, and every ghost starts where Pacman can reach
+// or right next to it. Level 3's extra ghost starts in the wall of the
+// house door at (7, 11) and steps out on its first move.
+constexpr bool spawnsReachable() {
+    MapLayout::Reach r = CLASSIC_LAYOUT.reachFrom(PAC_START_X, PAC_START_Y);
+    for (const GhostSpawn& g : GHOST_SPAWNS)
+        if (!r.has(g.x, g.y) && !r.has(g.x - 1, g.y) && !r.has(g.x + 1, g.y)
+            && !r.has(g.x, g.y - 1) && !r.has(g.x, g.y + 1))
+            return false;
+    for (const KeySpawn& k : KEY_SPAWNS)
+        if (!r.has(k.x, k.y)) return false;
+    return true;
+}
+
+constexpr bool spawnLevelsValid() {
+    for (const GhostSpawn& g : GHOST_SPAWNS)
+        if (g.level < 1 || g.level > LAST_LEVEL) return false;
+    for (const KeySpawn& k : KEY_SPAWNS)
+        if (k.level < 1 || k.level > LAST_LEVEL) return false;
+    return true;
+}
+
+static_assert(CLASSIC_LAYOUT.isOpen(PAC_START_X, PAC_START_Y), "Pacman starts inside a wall");
+static_assert(CLASSIC_LAYOUT.dotsReachableFrom(PAC_START_X, PAC_START_Y), "a dot cannot be reached");
+static_assert(spawnsReachable(), "a ghost or key spawns where Pacman cannot reach");
+static_assert(spawnLevelsValid(), "a spawn names a level that does not exist");
+
+
+class Entity {
+protected:
+    int gridX, gridY, posX, posY;
+    int prevPosX, prevPosY;     // posX/posY before the current tick, for interpolation
+public:
+    Entity(int gx, int gy)
+        : gridX(gx), gridY(gy),
+        posX(gy* CELL_SIZE), posY(gx* CELL_SIZE),
+        prevPosX(posX), prevPosY(posY) {
+    }
+    virtual ~Entity() {}
+    virtual void update(Map& map) = 0;
+    int getGridX() const { return gridX; }
+    int getGridY() const { return gridY; }
+    int getPosX() const { return posX; }
+    int getPosY() const { return posY; }
+    int getPrevPosX() const { return prevPosX; }
+    int getPrevPosY() const { return prevPosY; }
+    void savePrev() { prevPosX = posX; prevPosY = posY; }
+};
+
+
+// Pacman as plain data, for snapshots.
+struct PacState {
+    int gridX, gridY, posX, posY, prevPosX, prevPosY;
+    int intent, previousIntent, mouthToggle, lastMouthDir;
+    bool hasKey;
+    char eaten;
+};
+
+
+class Pacman : public Entity {
+    int intent, previousIntent;
+    int mouthToggle, lastMouthDir;
+    bool hasKey;
+    char eaten;     // what the last update() picked up: DOT, KEY or EMPTY
+
+public:
+    Pacman(int gx, int gy)
+        : Entity(gx, gy),
+        intent(DIR_NONE), previousIntent(DIR_NONE),
+        mouthToggle(0), lastMouthDir(3),
+        hasKey(false), eaten(EMPTY)
+    {
+    }
+
+    bool getHasKey() const { return hasKey; }
+    void setHasKey(bool v) { hasKey = v; }
+    char getEaten() const { return eaten; }
+    int getIntent() const { return intent; }
+    int getMouthToggle() const { return mouthToggle; }
+    int getMouthDir() const { return lastMouthDir; }
+
+    void handleKey(int dir) {
+        if (dir == DIR_NONE) return;
+        previousIntent = intent;
+        intent = dir;
+    }
+
+    // Pacman's movement on plain fields, shared with VecEnv: through the
+    // tunnel if he is at a mouth, then one cell towards `intent` if the
+    // maze is open that way. Returns the direction taken, or DIR_NONE.
+    static int moveRule(const Map& map, int& x, int& y, int intent) {
+        if (map.isTunnelRow(x)) {
+            if (intent != DIR_LEFT && y >= MAP_COLS - 1) y = 0;
+            else if (intent != DIR_RIGHT && y < 0) y = MAP_COLS - 1;
+            else if (y < 0 || y >= MAP_COLS) {
+                // Off the board in the mouth, facing back in. exits() has
+                // nothing out here, so step onto the edge cell directly.
+                int edge = y < 0 ? 0 : MAP_COLS - 1;
+                if (map.isWall(x, edge)) return DIR_NONE;
+                y = edge;
+                return intent;
+            }
+        }
+        if (intent == DIR_NONE || !(map.exits(x, y) & dirBit(intent))) return DIR_NONE;
+        switch (intent) {
+        case DIR_UP:    x--; break;
+        case DIR_DOWN:  x++; break;
+        case DIR_LEFT:  y--; break;
+        default:        y++; break;
+        }
+        return intent;
+    }
+
+    // Whatever is on (x, y) to be eaten, DOT, KEY or EMPTY, taken off the board.
+    static char eatRule(Map& map, int x, int y) {
+        char c = map.get(x, y);
+        if (c != DOT && c != KEY) return EMPTY;
+        map.set(x, y, EMPTY);
+        return c;
+    }
+
+    void update(Map& map) override {
+        static const unsigned char mouthOf[5] = { 3, 1, 0, 3, 2 };     // by DIR_*
+
+        eaten = EMPTY;
+        int moved = moveRule(map, gridX, gridY, intent);
+        if (moved != DIR_NONE) {
+            lastMouthDir = mouthOf[moved];
+            eaten = eatRule(map, gridX, gridY);
+            if (eaten == KEY) hasKey = true;
+        }
+
+        mouthToggle++;
+
+        posX = gridY * CELL_SIZE;
+        posY = gridX * CELL_SIZE;
+    }
+
+    PacState save() const {
+        return { gridX, gridY, posX, posY, prevPosX, prevPosY,
+            intent, previousIntent, mouthToggle, lastMouthDir, hasKey, eaten };
+    }
+
+    void restore(const PacState& s) {
+        gridX = s.gridX; gridY = s.gridY;
+        posX = s.posX; posY = s.posY;
+        prevPosX = s.prevPosX; prevPosY = s.prevPosY;
+        intent = s.intent; previousIntent = s.previousIntent;
+        mouthToggle = s.mouthToggle; lastMouthDir = s.lastMouthDir;
+        hasKey = s.hasKey; eaten = s.eaten;
+    }
+
+    void resetPosition(int gx, int gy) {
+        gridX = gx;
+        gridY = gy;
+        posX = gy * CELL_SIZE;
+        posY = gx * CELL_SIZE;
+        savePrev();
+    }
+};
+
+
+// What happened during one Simulation::step(), so the front end can play
+// sounds and schedule pauses without looking inside the rules.
+struct TickResult {
+    bool ateDot = false;
+    bool ateKey = false;
+    bool levelUp = false;
+    bool lostLife = false;
+    bool gameOver = false;
+    bool won = false;
+    int eatenX = -1, eatenY = -1;   // the cell ateDot or ateKey took, before a death moves Pacman off it
+};
+
+
+// The pace of play around the simulation, kept by the front end and the
+// game server alike: ticks per second, and in seconds how long play stops
+// before the first tick and after a tick that ends a level, a life or the
+// game.
+const float FPS = 6.6f;     // default simulation ticks per second
+const double READY_PAUSE = 3.1;
+const double LEVEL_PAUSE = 1.0;
+const double DEATH_PAUSE = 1.0;
+const double GAME_OVER_PAUSE = 2.0;
+const double WON_PAUSE = 4.0;
+
+// Seconds of pause after a tick that returned `r`, 0 to play on.
+inline double pauseAfter(const TickResult& r) {
+    if (r.levelUp) return LEVEL_PAUSE;
+    if (r.won) return WON_PAUSE;
+    if (r.lostLife) return DEATH_PAUSE;
+    if (r.gameOver) return GAME_OVER_PAUSE;
+    return 0;
+}
+
+
+// The whole state of a Simulation as plain data: taking one or putting
+// one back is a few hundred bytes of copying and never allocates.
+struct SimSnapshot {
+    Map map;
+    PacState pac;
+    GhostState ghosts[GHOST_SPAWN_COUNT];
+    int ghostCount;
+    Scheduler<GHOST_SPAWN_COUNT> releases;
+    uint64_t rngState, seed;
+    int bola, score, frameCount, currentLevel, lives;
+    bool keyAvailable, hasExtraLife, gameover, won;
+    int caughtBy, deathFrame;
+};
+
+
+class Simulation {
+    Map map;
+    Pacman pac;
+    GhostSet ghosts;
+    const JunctionGraph* graph = &JunctionGraph::classic();
+    Scheduler<GHOST_SPAWN_COUNT> releases;  // ghost spawn index, due at its delay tick
+    Rng rng;
+    uint64_t seed = 0;
+
+    int bola = 0, score = 0, frameCount = 0;
+    int currentLevel = 1;
+    int lives = 0;
+    bool keyAvailable = false;
+    bool hasExtraLife = false;
+    bool gameover = false, won = false;
+    int caughtBy = -1;      // GhostKind that ended the game, -1 if none
+    int deathFrame = -1;    // tick of the latest death, -1 if none
+    bool profiled = false;  // time step()'s phases; not part of the game state
+
+
+    // Refills the ghost pool in place from GHOST_SPAWNS; the pool was
+    // sized for the largest level up front, so this never allocates.
+    // Delays count from the start of the game, not from the spawn, so
+    // ghosts respawned late in a game are due at once.
+    void spawnGhosts() {
+        ghosts.clear();
+        releases.clear();
+        for (const GhostSpawn& g : GHOST_SPAWNS) {
+            if (g.level > currentLevel) continue;
+            int i = ghosts.add(g.kind, g.x, g.y, g.sprite, g.delay);
+            releases.schedule(g.delay, i);
+        }
+    }
+
+    // A fresh board for `level`: all dots, the level's keys, everyone back
+    // at the start and no extra life.
+    void startLevel(int level) {
+        currentLevel = level;
+        const LevelBoard& board = LEVEL_BOARDS[level];
+        map = board.map;
+        keyAvailable = board.keys;
+        bola = board.dots;
+        lives = 0;
+        hasExtraLife = false;
+        pac = Pacman(PAC_START_X, PAC_START_Y);
+        spawnGhosts();
+    }
+
+    // After a death: the board stays, the actors go back to the start.
+    void resetEntities() {
+        pac.resetPosition(PAC_START_X, PAC_START_Y);
+        spawnGhosts();
+    }
+
+public:
+    explicit Simulation(uint64_t seed = 1) : pac(PAC_START_X, PAC_START_Y) {
+        int perKind[GHOST_KIND_COUNT] = {};
+        for (const GhostSpawn& g : GHOST_SPAWNS) perKind[g.kind]++;
+        for (int k = 0; k < GHOST_KIND_COUNT; k++) ghosts.reserve(k, perKind[k]);
+        reset(seed);
+    }
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Back to the first tick of level 1, with the generator reseeded.
+    void reset(uint64_t newSeed) {
+        seed = newSeed;
+        rng.reseed(seed);
+        score = 0;
+        frameCount = 0;
+        gameover = false;
+        won = false;
+        caughtBy = -1;
+        deathFrame = -1;
+        startLevel(1);
+    }
+
+    // Advance the game by one tick. `input` is a DIR_* intent, or DIR_NONE
+    // to keep the current one. Once the game is over or won, this is a no-op.
+    TickResult step(int input) {
+        TickResult r;
+        if (gameover || won) return r;
+        PhaseTimer tickTime(PH_TICK, profiled);
+
+        pac.handleKey(input);
+        pac.savePrev();
+        int fromX = pac.getGridX(), fromY = pac.getGridY();
+        frameCount++;
+        int due;
+        while (releases.popDue(frameCount, due)) ghosts.release(due);
+        {
+            PhaseTimer t(PH_PACMAN, profiled);
+            pac.update(map);
+        }
+        if (pac.getEaten() == DOT) {
+            bola--; score++;
+            r.ateDot = true;
+        }
+        else if (pac.getEaten() == KEY) {
+            score += 50;
+            r.ateKey = true;
+        }
+        if (r.ateDot || r.ateKey) {
+            r.eatenX = pac.getGridX();
+            r.eatenY = pac.getGridY();
+        }
+        {
+            PhaseTimer t(PH_GHOSTS, profiled);
+            ghosts.move(map, pac.getGridX(), pac.getGridY(), rng, *graph);
+        }
+        PhaseTimer rulesTime(PH_RULES, profiled);
+
+        if ((currentLevel == 2 || currentLevel == 3) && pac.getHasKey()) {
+            hasExtraLife = true;
+            pac.setHasKey(false);
+            keyAvailable = (currentLevel == 3 && map.get(10, 5) == KEY) ||
+                (currentLevel == 3 && map.get(10, 17) == KEY);
+            lives = 1;
+        }
+
+
+        int target = levelTarget(currentLevel);
+        if (target >= 0 && score >= target) {
+            startLevel(currentLevel + 1);
+            r.levelUp = true;
+            return r;
+        }
+
+
+        if (bola == 0 && currentLevel == LAST_LEVEL) {
+            won = true;
+            r.won = true;
+            return r;
+        }
+
+
+        int hit = ghosts.firstHit(fromX, fromY, pac.getGridX(), pac.getGridY());
+        if (hit >= 0) {
+            deathFrame = frameCount;
+            if (hasExtraLife) {
+                hasExtraLife = false;
+                lives = 0;
+                resetEntities();
+                r.lostLife = true;
+            }
+            else {
+                gameover = true;
+                caughtBy = ghosts.get(hit).getKind();
+                r.gameOver = true;
+            }
+        }
+        return r;
+    }
+
+    void save(SimSnapshot& s) const {
+        s.map = map;
+        s.pac = pac.save();
+        s.ghostCount = ghosts.size();
+        for (int i = 0; i < s.ghostCount; i++) s.ghosts[i] = ghosts.save(i);
+        s.releases = releases;
+        s.rngState = rng.getState();
+        s.seed = seed;
+        s.bola = bola; s.score = score; s.frameCount = frameCount;
+        s.currentLevel = currentLevel; s.lives = lives;
+        s.keyAvailable = keyAvailable; s.hasExtraLife = hasExtraLife;
+        s.gameover = gameover; s.won = won;
+        s.caughtBy = caughtBy; s.deathFrame = deathFrame;
+    }
+
+    // Puts the game back exactly as it was when `s` was taken; stepping on
+    // from there with the same inputs repeats the same ticks.
+    void restore(const SimSnapshot& s) {
+        map = s.map;
+        pac.restore(s.pac);
+        ghosts.restore(s.ghosts, s.ghostCount);
+        releases = s.releases;
+        rng.setState(s.rngState);
+        seed = s.seed;
+        bola = s.bola; score = s.score; frameCount = s.frameCount;
+        currentLevel = s.currentLevel; lives = s.lives;
+        keyAvailable = s.keyAvailable; hasExtraLife = s.hasExtraLife;
+        gameover = s.gameover; won = s.won;
+        caughtBy = s.caughtBy; deathFrame = s.deathFrame;
+    }
+
+    // Zobrist hash of the position: the board, where everyone stands, the
+    // level and the extra life. Two games with the same hash play on alike
+    // from here up to the dice, the clock (which decides the releases still
+    // due), the ghosts' headings and Pacman's queued intent, which it leaves
+    // out. Costs a few XORs.
+    uint64_t hash() const {
+        const ZobristKeys& z = ZOBRIST;
+        return map.getHash() ^ ghosts.getHash()
+            ^ z.actor[0][actorCell(pac.getGridX(), pac.getGridY())]
+            ^ z.level[currentLevel & (ZobristKeys::LEVELS - 1)]
+            ^ (hasExtraLife ? z.extraLife : 0);
+    }
+
+    // hash() plus what it leaves out that the next `ticks` ticks still
+    // depend on: every ghost's heading, and how many ticks off each pending
+    // release is, or that it lies beyond them. Keys AutoPlayer's
+    // transposition table, whose entries outlive a decision and a game.
+    uint64_t hashAhead(int ticks) const {
+        const ZobristKeys& z = ZOBRIST;
+        if (ticks > ZobristKeys::RELEASE_TICKS - 1) ticks = ZobristKeys::RELEASE_TICKS - 1;
+        uint64_t h = hash();
+        for (int i = 0; i < ghosts.size(); i++)
+            h ^= z.heading[i][ghosts.save(i).lastDir];
+        releases.forEach([&](uint64_t at, int spawn) {
+            uint64_t now = (uint64_t)frameCount, left = at > now ? at - now : 0;
+            h ^= z.release[spawn][left <= (uint64_t)ticks ? left : ticks + 1];
+        });
+        return h;
+    }
+
+    const Map& getMap() const { return map; }
+    const Pacman& getPacman() const { return pac; }
+    const GhostSet& getGhosts() const { return ghosts; }
+    const PathTable& getPaths() const { return PathTable::classic(); }
+    const JunctionGraph& getGraph() const { return *graph; }
+    uint64_t getSeed() const { return seed; }
+
+    // Off by default, so scratch games (AutoPlayer's search, batch and
+    // server sessions) cost nothing extra under --profile. Whoever runs
+    // the game being measured turns it on.
+    void setProfiled(bool on) { profiled = on; }
+    int getScore() const { return score; }
+    int getBola() const { return bola; }
+    int getFrameCount() const { return frameCount; }
+    int getLevel() const { return currentLevel; }
+    int getLives() const { return lives; }
+    bool isKeyAvailable() const { return keyAvailable; }
+    bool hasExtraLifeAvailable() const { return hasExtraLife; }
+    bool isGameOver() const { return gameover; }
+    bool isWon() const { return won; }
+    bool isFinished() const { return gameover || won; }
+    int getCaughtBy() const { return caughtBy; }
+    int getDeathFrame() const { return deathFrame; }
+};
+
+static_assert(is_trivially_copyable<SimSnapshot>::value, "snapshots are copied as plain bytes");
@@ -0,0 +1,51 @@
+#pragma once
+// Rewind history: the last few thousand ticks as SimSnapshots in a ring
+// that is allocated once. Pushing overwrites the oldest entry when full;
+// rewinding restores an entry in constant time and forgets everything newer,
+// so play (or a search) simply carries on from there.
+#include <vector>
+#include "Sim.h"
+
+using namespace std;
+
+
+class SnapshotRing {
+    vector<SimSnapshot> slots;
+    int head = 0;       // next slot to write
+    int count = 0;
+
+public:
+    explicit SnapshotRing(int capacity) : slots(capacity > 0 ? capacity : 1) {}
+
+    int size() const { return count; }
+    int capacity() const { return (int)slots.size(); }
+    void clear() { head = count = 0; }
+
+    // Saves `sim` as the newest entry.
+    void push(const Simulation& sim) {
+        sim.save(slots[head]);
+        if (++head == capacity()) head = 0;
+        if (count < capacity()) count++;
+    }
+
+    // The entry `back` pushes ago, 0 being the newest; nullptr past the
+    // oldest one kept.
+    const SimSnapshot* peek(int back) const {
+        if (back < 0 || back >= count) return nullptr;
+        int i = head - 1 - back;
+        return &slots[i < 0 ? i + capacity() : i];
+    }
+
+    // Restores the entry `back` pushes ago, or the oldest if the history is
+    // shorter, and drops everything newer. False if there is nothing kept.
+    bool rewind(Simulation& sim, int back) {
+        if (count == 0) return false;
+        if (back >= count) back = count - 1;
+        if (back < 0) back = 0;
+        sim.restore(*peek(back));
+        head -= back + 1;
+        if (head < 0) head += capacity();
+        count -= back + 1;
+        return true;
+    }
+};
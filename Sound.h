@@ -0,0 +1,155 @@
+#pragma once
+// Sound effects in two halves, so the game loop never talks to the audio
+// system:
+//
+//   - SoundQueue is what simTick() and the rest of the game logic write
+//     to. Posting an effect sets a flag and keeps the loudest gain; the
+//     same effect posted again before the next flush is merged into it.
+//     It is a fixed-size array: nothing allocates, nothing locks.
+//   - SoundMixer drains the queue once per rendered frame into a pool of
+//     sample instances made up front, a few per effect, attached to the
+//     default mixer. An effect already playing on all of its voices
+//     restarts the one that has played longest instead of taking another
+//     effect's voice or being dropped.
+//
+// One looping background sound at a time is part of the queue too: the
+// logic asks for a loop (or none), and the mixer switches on the next flush.
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_audio.h>
+
+using namespace std;
+
+
+enum SoundEffect { SFX_BEGINNING, SFX_DEATH, SFX_WAKA, SFX_SUSPENSE, SFX_COUNT };
+
+// How many copies of each effect may play at once. A looping effect
+// holds one of its own voices while it loops.
+constexpr int SFX_VOICES[SFX_COUNT] = { 1, 1, 2, 1 };
+
+constexpr int voicePoolSize() {
+    int n = 0;
+    for (int v : SFX_VOICES) n += v;
+    return n;
+}
+const int SFX_POOL = voicePoolSize();
+
+
+class SoundQueue {
+    float gain[SFX_COUNT] = {};     // > 0: play once at this gain on the next flush
+    int loop = -1;                  // SoundEffect to loop, -1 for none
+    float loopGain = 0;
+    bool loopChanged = false;
+
+public:
+    void play(int sfx, float g) {
+        if (g > gain[sfx]) gain[sfx] = g;
+    }
+
+    // Restarts `sfx` as the background loop, replacing any other.
+    void startLoop(int sfx, float g) {
+        loop = sfx;
+        loopGain = g;
+        loopChanged = true;
+    }
+
+    void stopLoop() {
+        loop = -1;
+        loopChanged = true;
+    }
+
+    // Hands the pending one-shots to f(sfx, gain) and clears them.
+    template <class F> void drainOneShots(F f) {
+        for (int s = 0; s < SFX_COUNT; s++)
+            if (gain[s] > 0) {
+                f(s, gain[s]);
+                gain[s] = 0;
+            }
+    }
+
+    // The loop to switch to, if it changed since the last call.
+    bool takeLoop(int& sfx, float& g) {
+        if (!loopChanged) return false;
+        loopChanged = false;
+        sfx = loop;
+        g = loopGain;
+        return true;
+    }
+};
+
+
+class SoundMixer {
+    struct Voice {
+        ALLEGRO_SAMPLE_INSTANCE* inst = nullptr;
+        unsigned started = 0;       // flush count when it last started
+    };
+
+    Voice voices[SFX_POOL];
+    int first[SFX_COUNT] = {};      // first voice of each effect in `voices`
+    ALLEGRO_SAMPLE_INSTANCE* loopVoice = nullptr;
+    unsigned flushes = 0;
+
+public:
+    // Builds the pool for `samples[SFX_*]`; missing samples get no voices
+    // and are silently skipped. Needs al_reserve_samples() for the default
+    // mixer.
+    bool open(ALLEGRO_SAMPLE* const* samples) {
+        ALLEGRO_MIXER* mixer = al_get_default_mixer();
+        if (!mixer) return false;
+        int v = 0;
+        for (int s = 0; s < SFX_COUNT; s++) {
+            first[s] = v;
+            for (int k = 0; k < SFX_VOICES[s]; k++, v++) {
+                if (!samples[s]) continue;
+                voices[v].inst = al_create_sample_instance(samples[s]);
+                if (!voices[v].inst || !al_attach_sample_instance_to_mixer(voices[v].inst, mixer))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        for (Voice& v : voices) {
+            if (v.inst) al_destroy_sample_instance(v.inst);
+            v.inst = nullptr;
+        }
+        loopVoice = nullptr;
+    }
+
+    // Starts whatever `q` has collected since the previous flush.
+    void flush(SoundQueue& q) {
+        flushes++;
+
+        int sfx;
+        float g;
+        if (q.takeLoop(sfx, g)) {
+            if (loopVoice) al_stop_sample_instance(loopVoice);
+            loopVoice = nullptr;
+            if (sfx >= 0) loopVoice = start(sfx, g, ALLEGRO_PLAYMODE_LOOP);
+        }
+
+        q.drainOneShots([&](int s, float gain) {
+            start(s, gain, ALLEGRO_PLAYMODE_ONCE);
+            });
+    }
+
+private:
+    // An idle voice of `sfx`, else its oldest one that is not the loop.
+    ALLEGRO_SAMPLE_INSTANCE* start(int sfx, float gain, ALLEGRO_PLAYMODE mode) {
+        Voice* pick = nullptr;
+        for (int k = 0; k < SFX_VOICES[sfx]; k++) {
+            Voice& v = voices[first[sfx] + k];
+            if (!v.inst || v.inst == loopVoice) continue;
+            if (!al_get_sample_instance_playing(v.inst)) { pick = &v; break; }
+            if (!pick || v.started < pick->started) pick = &v;
+        }
+        if (!pick) return nullptr;
+        al_stop_sample_instance(pick->inst);
+        al_set_sample_instance_playmode(pick->inst, mode);
+        al_set_sample_instance_gain(pick->inst, gain);
+        al_set_sample_instance_position(pick->inst, 0);
+        al_play_sample_instance(pick->inst);
+        pick->started = flushes;
+        return pick->inst;
+    }
+};
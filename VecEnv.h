@@ -0,0 +1,310 @@
+#pragma once
+// Batched environment for training agents: N games stepped together, gym
+// style. reset(seeds) starts every game; step(actions) advances each by one
+// tick and fills the observation, reward and done buffers.
+//
+// The batch is kept as structure-of-arrays, one array per field over all
+// games, and a step is a few flat passes over the whole batch: Pacman and
+// scoring, then each ghost kind through GhostRules with the ghosts of
+// neighbouring games sharing SIMD blocks, then levels and collisions. The
+// rules are Simulation's own (Pacman::moveRule/eatRule, GhostRules,
+// levelTarget, LEVEL_BOARDS), so a game in the batch plays tick for tick like
+// a Simulation given the same seed and inputs.
+//
+// Observations, per game:
+//   planes    OBS_PLANES bitboards of MAP_WORDS words, bit c % 64 of word
+//             c / 64 for cell c = row * MAP_COLS + col: walls, dots, keys,
+//             Pacman, ghosts. numpy.unpackbits(..., bitorder='little')
+//             makes them a [OBS_PLANES][MAP_ROWS][MAP_COLS] tensor.
+//   features  OBS_FEATURES int16: Pacman's row and column, each ghost's in
+//             GHOST_SPAWNS order (-1, -1 while it is not in the level), the
+//             level, and 1 if the extra life is held.
+//
+// The reward is the score gained in the tick, plus DEATH_REWARD when a
+// ghost catches Pacman. A game that ends (caught, won, or maxFrames
+// reached) reports done, keeps its GameResult in lastResult(), and starts
+// over at once on seed + size(); the observation is already the new game's.
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Batch.h"
+#include "Ghosts.h"
+#include "JunctionGraph.h"
+#include "Map.h"
+#include "PathTable.h"
+#include "Rng.h"
+#include "Sim.h"
+
+using namespace std;
+
+
+class VecEnv {
+public:
+    static const int OBS_PLANES = 5;
+    static const int OBS_FEATURES = 2 + 2 * GHOST_SPAWN_COUNT + 2;
+    static constexpr float DEATH_REWARD = -100.0f;
+
+private:
+    static const int LANES = GhostRules::LANES;
+
+    // Every game's ghosts of one kind: game g's slot s is lane
+    // g * perGame + s, padded to whole blocks with lanes never released.
+    struct KindLanes {
+        int perGame = 0;
+        int spawn[GHOST_SPAWN_COUNT] = {};      // slot -> GHOST_SPAWNS index
+        vector<short> x, y, prevX, prevY;
+        vector<unsigned char> released, present, lastDir;
+
+        void resize(int lanes) {
+            x.assign(lanes, 0); y.assign(lanes, 0);
+            prevX.assign(lanes, 0); prevY.assign(lanes, 0);
+            released.assign(lanes, 0); present.assign(lanes, 0);
+            lastDir.assign(lanes, DIR_NONE);
+        }
+    };
+
+    int n, maxFrames;
+    const JunctionGraph& graph = JunctionGraph::classic();
+
+    vector<Map> boards;
+    vector<Rng> rngs;
+    vector<uint64_t> seeds;
+    vector<short> pacX, pacY, fromX, fromY;
+    vector<unsigned char> intent, hasKey, extraLife;
+    vector<int> score, frame, level, bola;
+    vector<JunctionGraph::Target> pacTarget, ambushTarget;
+    KindLanes kinds[GHOST_KIND_COUNT];
+    int kindOf[GHOST_SPAWN_COUNT], slotOf[GHOST_SPAWN_COUNT];
+
+    vector<uint64_t> planes;
+    vector<short> features;
+    vector<float> rewards;
+    vector<unsigned char> dones;
+    vector<GameResult> results;
+
+    void spawnGhosts(int g) {
+        for (int s = 0; s < GHOST_SPAWN_COUNT; s++) {
+            const GhostSpawn& sp = GHOST_SPAWNS[s];
+            KindLanes& k = kinds[kindOf[s]];
+            int i = g * k.perGame + slotOf[s];
+            k.x[i] = k.prevX[i] = (short)sp.x;
+            k.y[i] = k.prevY[i] = (short)sp.y;
+            k.released[i] = 0;
+            k.present[i] = sp.level <= level[g];
+            k.lastDir[i] = DIR_NONE;
+        }
+    }
+
+    void startLevel(int g, int lvl) {
+        level[g] = lvl;
+        boards[g] = LEVEL_BOARDS[lvl].map;
+        bola[g] = LEVEL_BOARDS[lvl].dots;
+        extraLife[g] = 0;
+        hasKey[g] = 0;
+        intent[g] = DIR_NONE;
+        pacX[g] = PAC_START_X;
+        pacY[g] = PAC_START_Y;
+        spawnGhosts(g);
+    }
+
+    void resetGame(int g, uint64_t seed) {
+        seeds[g] = seed;
+        rngs[g].reseed(seed);
+        score[g] = 0;
+        frame[g] = 0;
+        startLevel(g, 1);
+        writeObservation(g, true);
+    }
+
+    void endGame(int g, int end, int killer) {
+        GameResult& r = results[g];
+        r.seed = seeds[g];
+        r.score = score[g];
+        r.level = level[g];
+        r.frames = frame[g];
+        r.end = end;
+        r.killer = killer;
+        dones[g] = 1;
+        resetGame(g, seeds[g] + n);
+    }
+
+    // Kind of the first-spawned ghost that caught Pacman this tick, or -1;
+    // the same test as GhostSet::firstHit.
+    int caughtBy(int g) const {
+        int tx = pacX[g], ty = pacY[g], fx = fromX[g], fy = fromY[g];
+        bool moved = fx != tx || fy != ty;
+        for (int s = 0; s < GHOST_SPAWN_COUNT; s++) {
+            const KindLanes& k = kinds[kindOf[s]];
+            int i = g * k.perGame + slotOf[s];
+            if (!k.present[i]) continue;
+            bool on = k.x[i] == tx && k.y[i] == ty;
+            bool crossed = moved && k.x[i] == fx && k.y[i] == fy && k.prevX[i] == tx && k.prevY[i] == ty;
+            if (on || crossed) return kindOf[s];
+        }
+        return -1;
+    }
+
+    void moveGhosts(int kind) {
+        KindLanes& k = kinds[kind];
+        int lanes = n * k.perGame, per = k.perGame;
+        for (int b = 0; b < lanes; b += LANES) {
+            GhostRules::Moves m = {};
+            int end = lanes - b < LANES ? lanes - b : LANES;
+            for (int i = 0; i < end; i++) {
+                if (!k.released[b + i]) continue;
+                int g = (b + i) / per;
+                GhostRules::chooseStep(k.x[b + i], k.y[b + i], k.lastDir[b + i], kind, boards[g],
+                    pacTarget[g], ambushTarget[g], rngs[g], graph, m, i);
+            }
+            if (kind == GHOST_RANDOM)
+                GhostRules::pickRandomMoves(&k.x[b], &k.y[b], &k.released[b], &k.lastDir[b],
+                    [&](int i) -> const JunctionGraph::Target& { return pacTarget[(b + i) / per]; },
+                    graph, m);
+            GhostRules::applyMoves(&k.x[b], &k.y[b], &k.prevX[b], &k.prevY[b], LANES, m);
+        }
+    }
+
+    // The walls plane never changes, so only resetGame() writes it.
+    void writeObservation(int g, bool walls = false) {
+        uint64_t* p = &planes[(size_t)g * OBS_PLANES * MAP_WORDS];
+        const Map& map = boards[g];
+        const uint64_t* dots = map.dotBits();
+        const uint64_t* keys = map.keyBits();
+        if (walls)
+            for (int w = 0; w < MAP_WORDS; w++) p[w] = map.getLayout().walls[w];
+        for (int w = 0; w < MAP_WORDS; w++) {
+            p[MAP_WORDS + w] = dots[w];
+            p[2 * MAP_WORDS + w] = keys[w];
+            p[3 * MAP_WORDS + w] = 0;
+            p[4 * MAP_WORDS + w] = 0;
+        }
+        auto mark = [](uint64_t* plane, int x, int y) {
+            if ((unsigned)x < (unsigned)MAP_ROWS && (unsigned)y < (unsigned)MAP_COLS)
+                setBit(plane, cellIndex(x, y));
+            };
+
+        short* f = &features[(size_t)g * OBS_FEATURES];
+        mark(p + 3 * MAP_WORDS, pacX[g], pacY[g]);
+        f[0] = pacX[g];
+        f[1] = pacY[g];
+        for (int s = 0; s < GHOST_SPAWN_COUNT; s++) {
+            const KindLanes& k = kinds[kindOf[s]];
+            int i = g * k.perGame + slotOf[s];
+            bool here = k.present[i] != 0;
+            if (here) mark(p + 4 * MAP_WORDS, k.x[i], k.y[i]);
+            f[2 + 2 * s] = here ? k.x[i] : -1;
+            f[3 + 2 * s] = here ? k.y[i] : -1;
+        }
+        f[2 + 2 * GHOST_SPAWN_COUNT] = (short)level[g];
+        f[3 + 2 * GHOST_SPAWN_COUNT] = extraLife[g];
+    }
+
+public:
+    // `maxFrames` ends a game that runs that long; 0 lets games run until
+    // they are won or lost.
+    explicit VecEnv(int count, int maxFrames = 0)
+        : n(count > 0 ? count : 1), maxFrames(maxFrames),
+        boards(n), rngs(n), seeds(n),
+        pacX(n), pacY(n), fromX(n), fromY(n),
+        intent(n), hasKey(n), extraLife(n),
+        score(n), frame(n), level(n), bola(n), pacTarget(n), ambushTarget(n),
+        planes((size_t)n * OBS_PLANES * MAP_WORDS), features((size_t)n * OBS_FEATURES),
+        rewards(n), dones(n), results(n)
+    {
+        for (int s = 0; s < GHOST_SPAWN_COUNT; s++) {
+            KindLanes& k = kinds[GHOST_SPAWNS[s].kind];
+            kindOf[s] = GHOST_SPAWNS[s].kind;
+            slotOf[s] = k.perGame;
+            k.spawn[k.perGame++] = s;
+        }
+        for (KindLanes& k : kinds)
+            k.resize((n * k.perGame + LANES - 1) / LANES * LANES);
+        for (int g = 0; g < n; g++) resetGame(g, (uint64_t)g + 1);
+    }
+    VecEnv(const VecEnv&) = delete;
+    VecEnv& operator=(const VecEnv&) = delete;
+
+    int size() const { return n; }
+
+    // Starts game g on seeds[g], for every game.
+    void reset(const uint64_t* newSeeds) {
+        for (int g = 0; g < n; g++) {
+            resetGame(g, newSeeds[g]);
+            rewards[g] = 0;
+            dones[g] = 0;
+        }
+    }
+
+    // One tick of every game; actions[g] is a DIR_* intent, or DIR_NONE to
+    // keep the current one.
+    void step(const int* actions) {
+        // Pacman, what he eats, and which ghosts leave the house.
+        for (int g = 0; g < n; g++) {
+            rewards[g] = (float)-score[g];
+            dones[g] = 0;
+            if (actions[g] != DIR_NONE) intent[g] = (unsigned char)actions[g];
+            fromX[g] = pacX[g];
+            fromY[g] = pacY[g];
+            int f = ++frame[g];
+            for (int s = 0; s < GHOST_SPAWN_COUNT; s++) {
+                KindLanes& k = kinds[kindOf[s]];
+                int i = g * k.perGame + slotOf[s];
+                if (k.present[i] && GHOST_SPAWNS[s].delay <= f) k.released[i] = 1;
+            }
+
+            int x = pacX[g], y = pacY[g];
+            if (Pacman::moveRule(boards[g], x, y, intent[g]) != DIR_NONE) {
+                char c = Pacman::eatRule(boards[g], x, y);
+                if (c == DOT) { bola[g]--; score[g]++; }
+                else if (c == KEY) { score[g] += 50; hasKey[g] = 1; }
+            }
+            pacX[g] = (short)x;
+            pacY[g] = (short)y;
+            pacTarget[g] = graph.target(graph.idOf(x, y));
+            ambushTarget[g] = graph.target(graph.idOf(x + 2, y + 2));
+        }
+
+        for (int k = 0; k < GHOST_KIND_COUNT; k++)
+            if (kinds[k].perGame) moveGhosts(k);
+
+        // Keys, levels, the end of the game and collisions, as in
+        // Simulation::step().
+        for (int g = 0; g < n; g++) {
+            if ((level[g] == 2 || level[g] == 3) && hasKey[g]) {
+                extraLife[g] = 1;
+                hasKey[g] = 0;
+            }
+            rewards[g] += (float)score[g];
+
+            int target = levelTarget(level[g]);
+            if (target >= 0 && score[g] >= target) startLevel(g, level[g] + 1);
+            else if (bola[g] == 0 && level[g] == LAST_LEVEL) { endGame(g, END_WON, -1); continue; }
+            else {
+                int killer = caughtBy(g);
+                if (killer >= 0) {
+                    rewards[g] += DEATH_REWARD;
+                    if (!extraLife[g]) { endGame(g, END_CAUGHT, killer); continue; }
+                    extraLife[g] = 0;
+                    pacX[g] = PAC_START_X;
+                    pacY[g] = PAC_START_Y;
+                    spawnGhosts(g);
+                }
+            }
+            if (maxFrames > 0 && frame[g] >= maxFrames) { endGame(g, END_TIMEOUT, -1); continue; }
+            writeObservation(g);
+        }
+    }
+
+    // Output buffers, game-major, valid until the next reset() or step().
+    const uint64_t* observationPlanes() const { return planes.data(); }
+    const short* observationFeatures() const { return features.data(); }
+    const float* getRewards() const { return rewards.data(); }
+    const unsigned char* getDones() const { return dones.data(); }
+
+    // How game g's previous game ended, once done has been reported for it.
+    const GameResult& lastResult(int g) const { return results[g]; }
+
+    int getScore(int g) const { return score[g]; }
+    int getFrame(int g) const { return frame[g]; }
+    int getLevel(int g) const { return level[g]; }
+};
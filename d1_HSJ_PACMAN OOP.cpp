@@ -10,487 +10,456 @@
 #include <vector>
 #include <ctime>
 #include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "Assets.h"
+#include "Atlas.h"
+#include "AutoPlayer.h"
+#include "Sim.h"
+#include "Batch.h"
+#include "BigWorld.h"
+#include "InputLog.h"
+#include "InputQueue.h"
+#include "JunctionGraph.h"
+#include "MapFile.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+#include "Snapshot.h"
+#include "Sound.h"
+#include "VecEnv.h"
 
 using namespace std;
 
 
-const float FPS = 6.6f;
 const int SCREEN_W = 460;
 const int SCREEN_H = 550;
-const int CELL_SIZE = 20;
-const char WALL = '1';
-const char DOT = '2';
-const char EMPTY = '0';
-const char KEY = '3';
-const int TARGET_SCORE_LEVEL1 = 100;
-const int TARGET_SCORE_LEVEL2 = 175;
-const int TARGET_SCORE_LEVEL3 = 210;
-
-
-static const char RAW_MAP[24][24] = {
-    "11111111111111111111111",
-    "12222222222122222222221",
-    "12111211112121111211121",
-    "12111211112121111211121",
-    "12222222222222222222221",
-    "12111212111111121211121",
-    "12222212222122221222221",
-    "11111211110101111211111",
-    "11111210000000001211111",
-    "11111210111011101211111",
-    "00000000111011100000000",
-    "11111210111011101211111",
-    "11111210111111101211111",
-    "11111210000000001211111",
-    "11111210111111101211111",
-    "12222222222122222222221",
-    "12111211112121111211121",
-    "12221222222022222212221",
-    "11121212111111121212111",
-    "12222212222122221222221",
-    "12111111112121111111121",
-    "12222222222222222222221",
-    "11111111111111111111111"
-};
+const int BOARD_H = 460;    // the maze bitmaps; the HUD strip sits below
+const char* const ASSET_PACK = "assets/assets.pak";
+const int REWIND_HISTORY = 1024;    // ticks of rewind kept by the front end
+const double REWIND_SECONDS = 2.0;  // per press of the rewind key
 
+// Taken during static initialisation, as close to process start as we get
+// without platform calls; --startup-report measures from here.
+static const chrono::steady_clock::time_point processStart = chrono::steady_clock::now();
 
-class Map {
-    char grid[24][24];
-public:
-    Map() {
-        for (int i = 0; i < 24; i++)
-            for (int j = 0; j < 24; j++)
-                grid[i][j] = RAW_MAP[i][j];
-    }
-    char get(int i, int j) const { return grid[i][j]; }
-    void set(int i, int j, char v) { grid[i][j] = v; }
-};
-
+static double msSince(chrono::steady_clock::time_point t) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+}
 
-class Entity {
-protected:
-    int gridX, gridY, posX, posY;
-public:
-    Entity(int gx, int gy)
-        : gridX(gx), gridY(gy),
-        posX(gy* CELL_SIZE), posY(gx* CELL_SIZE) {
-    }
-    virtual ~Entity() {}
-    virtual void update(Map& map) = 0;
-    virtual void draw() const = 0;
-    int getGridX() const { return gridX; }
-    int getGridY() const { return gridY; }
+// Front-end states. Only STATE_PLAY advances the simulation; the others
+// keep drawing and handling input until a scheduled event moves on.
+enum FrontState { STATE_READY, STATE_PLAY, STATE_PAUSE, STATE_GAME_OVER, STATE_WON };
+
+// Events in Game::timers.
+enum TimedEvent { EV_PLAY, EV_RESUME_AFTER_DEATH, EV_EXIT };
+
+
+// Command-line switches that shape the front end.
+struct GameOptions {
+    uint64_t seed = 0;
+    bool atlas = true;          // --no-atlas: one texture per sprite, no batching
+    bool drawStats = false;     // --draw-stats: print per-frame GPU work
+    double tickRate = FPS;      // --tick-rate: simulation speed
+    double renderRate = 0;      // --render-rate: 0 follows the display refresh
+    bool usePack = true;        // --no-pack: decode the original files even if ASSET_PACK exists
+    bool cold = false;          // --cold: evict the asset files from the page cache first
+    bool startupReport = false; // --startup-report: time to the first frame
+    int loadThreads = 0;        // --load-threads: decoder threads, 0 = one per core
+    const char* recordPath = "last-session.paclog";  // --record, --no-record: the session's input log
+    const InputLog* replay = nullptr;   // --replay with --watch: play this log instead of the keyboard
+    bool autoplay = false;      // --autoplay: AutoPlayer plays instead of the keyboard
+    double turnBuffer = DEFAULT_TURN_BUFFER;    // --turn-buffer MS: how long a turn waits for its junction, 0 = off
+    bool turnReport = false;    // --turn-report: print press-to-move latency on exit
 };
 
 
-class Game;
+class Game {
+    GameOptions opts;
+    ALLEGRO_DISPLAY* display = nullptr;
+    ALLEGRO_TIMER* timer = nullptr;
+    ALLEGRO_EVENT_QUEUE* evq = nullptr;
+    ALLEGRO_FONT* font = nullptr;
+    ALLEGRO_FONT* smallFont = nullptr;  // builtin 8x8, for the profile overlay
 
+  
+    ALLEGRO_BITMAP* bmpMap, * bmpMapLevel3, * bmpDots, * bmpKey;
+    ALLEGRO_BITMAP* bmpPac, * bmpPUp, * bmpPDown, * bmpPLeft, * bmpPRight, * bmpPShut;
+    ALLEGRO_BITMAP* bmpBlue, * bmpYellow, * bmpRed, * bmpGreen, * bmpPink;
 
-class Pacman : public Entity {
-    int intent, previousIntent;
-    int mouthToggle, lastMouthDir;
-    ALLEGRO_BITMAP* bmp, * bmpUp, * bmpDown, * bmpLeft, * bmpRight, * bmpShut;
-    int* bolaPtr, * scorePtr;
-    bool hasKey;
+    
+    ALLEGRO_SAMPLE* sfxBegginning = nullptr;
+    ALLEGRO_SAMPLE* sfxDeath = nullptr;
+    ALLEGRO_SAMPLE* sfxSuspense = nullptr;
+    ALLEGRO_SAMPLE* sfxWaka = nullptr;
 
     
-    ALLEGRO_SAMPLE* sfxWaka;
+    SoundQueue sounds;          // written by the game logic
+    SoundMixer mixer;           // drains `sounds` once per rendered frame
+
+    ALLEGRO_BITMAP* ghostBmp[GHOST_SPRITE_COUNT] = {};
+    SpriteAtlas atlas;
+    AssetPack pack;             // open while samples loaded from it are alive
+    const char* loadMode = "";
+    double loadMs = 0;
+    bool firstFrameShown = false;
+    DrawStats stats;
+    int statFrames = 0;
+
+    // F3 overlay: each phase over the last whole second.
+    bool showProfile = false;
+    PhaseHistogram shownPhases[PH_COUNT];
+    double profileWindowStart = 0;
+
+    // Retained layers: the maze with its remaining dots and keys, and the
+    // HUD strip. Each is redrawn only when what it shows changes, so a
+    // frame is two blits plus the moving sprites.
+    ALLEGRO_BITMAP* boardLayer = nullptr;
+    ALLEGRO_BITMAP* hudLayer = nullptr;
+    int boardLevel = 0;
+    bool boardKeys = false;
+    int hudScore = -1, hudLevel = -1, hudLives = -1;
+    bool hudLife = false, hudKey = false;
+
+    Simulation sim;
+    InputLog log;               // this session, saved by finishLog()
+    InputLog::Player replayer;  // opts.replay, or an empty walk of `log`
+    SnapshotRing history{ REWIND_HISTORY };     // the state before each tick
+    InputQueue turns;           // arrow keys, timestamped, until their tick
+    TurnLatency latency;
+    AutoPlayer autoplayer;      // with opts.autoplay: decides every tick's input
+    bool exitGame = false, redraw = false;
+    FrontState state = STATE_READY;
+    Scheduler<4> timers;        // TimedEvent, due in ms of al_get_time()
+
+    // Fixed-timestep clock: the render timer runs at the display refresh
+    // rate and the simulation catches up in whole ticks of simDt. What is
+    // left over in `accumulator` says how far into the next tick we are.
+    double simDt = 1.0 / FPS;
+    double accumulator = 0, lastTime = 0;
+
+
+    static int keyToDir(int k) {
+        if (k == ALLEGRO_KEY_UP)    return DIR_UP;
+        if (k == ALLEGRO_KEY_DOWN)  return DIR_DOWN;
+        if (k == ALLEGRO_KEY_LEFT)  return DIR_LEFT;
+        if (k == ALLEGRO_KEY_RIGHT) return DIR_RIGHT;
+        return DIR_NONE;
+    }
 
-public:
-    Pacman(int gx, int gy,
-        ALLEGRO_BITMAP* base, ALLEGRO_BITMAP* u, ALLEGRO_BITMAP* d,
-        ALLEGRO_BITMAP* l, ALLEGRO_BITMAP* r, ALLEGRO_BITMAP* s,
-        int* bola, int* score,
-        ALLEGRO_SAMPLE* wakaSound)
-        : Entity(gx, gy),
-        intent(0), previousIntent(0),
-        mouthToggle(0), lastMouthDir(3),
-        bmp(base), bmpUp(u), bmpDown(d),
-        bmpLeft(l), bmpRight(r), bmpShut(s),
-        bolaPtr(bola), scorePtr(score),
-        hasKey(false),
-        sfxWaka(wakaSound)
-    {
+    ALLEGRO_BITMAP* pacmanBitmap() const {
+        const Pacman& p = sim.getPacman();
+        if (p.getMouthToggle() == 0) return bmpPac;
+        if (p.getMouthToggle() % 2 == 0) return bmpPShut;
+        switch (p.getMouthDir()) {
+        case 0: return bmpPDown;
+        case 1: return bmpPLeft;
+        case 2: return bmpPUp;
+        default: return bmpPRight;
+        }
     }
 
-    bool getHasKey() const { return hasKey; }
-    void setHasKey(bool v) { hasKey = v; }
 
-    void handleKey(int k) {
-        previousIntent = intent;
-        if (k == ALLEGRO_KEY_UP)    intent = 4;
-        else if (k == ALLEGRO_KEY_DOWN)  intent = 2;
-        else if (k == ALLEGRO_KEY_LEFT)  intent = 1;
-        else if (k == ALLEGRO_KEY_RIGHT) intent = 3;
+    // Sprites slide from last tick's cell to this one; anything that moved
+    // more than a cell (tunnel wrap, respawn) snaps instead.
+    static float lerpPos(int prev, int cur, float alpha) {
+        if (abs(cur - prev) > CELL_SIZE) return (float)cur;
+        return prev + (cur - prev) * alpha;
     }
 
-    void update(Map& map) override {
-       
-        if (intent != 1 && gridY >= 23) { gridX = 10; gridY = 0; }
-        else if (intent != 3 && gridY < 0) { gridX = 10; gridY = 23; }
-
-        auto tryEat = [&]() {
-            char c = map.get(gridX, gridY);
-            if (c == DOT) {
-                map.set(gridX, gridY, EMPTY);
-                (*bolaPtr)--; (*scorePtr)++;
-                
-                if (sfxWaka)
-                    al_play_sample(sfxWaka, 0.7, 0.0, 1.0, ALLEGRO_PLAYMODE_ONCE, nullptr);
-            }
-            else if (c == KEY) {
-                map.set(gridX, gridY, EMPTY);
-                hasKey = true;
-                (*scorePtr) += 50;
-                
-                if (sfxWaka)
-                    al_play_sample(sfxWaka, 0.7, 0.0, 1.0, ALLEGRO_PLAYMODE_ONCE, nullptr);
-            }
-            };
+    static uint64_t nowMs() { return (uint64_t)(al_get_time() * 1000.0); }
 
-     
-        if (intent == 4 && map.get(gridX - 1, gridY) != WALL) {
-            gridX--; lastMouthDir = 2; tryEat();
-        }
-        else if (intent == 2 && map.get(gridX + 1, gridY) != WALL) {
-            gridX++; lastMouthDir = 0; tryEat();
-        }
-        else if (intent == 1 && map.get(gridX, gridY - 1) != WALL) {
-            gridY--; lastMouthDir = 1; tryEat();
+    void after(double secs, int event) {
+        timers.schedule(nowMs() + (uint64_t)(secs * 1000.0), event);
+    }
+
+    void onTimedEvent(int event) {
+        if (event == EV_EXIT) {
+            exitGame = true;
+            return;
         }
-        else if (intent == 3 && map.get(gridX, gridY + 1) != WALL) {
-            gridY++; lastMouthDir = 3; tryEat();
+        if (event == EV_RESUME_AFTER_DEATH) {
+            if (sim.getLevel() == 3) startSuspenseLoop();
+            else startWakaLoop();
         }
+        state = STATE_PLAY;
+        resyncClock();
+        turns.resume(lastTime);
+    }
 
-       
-        mouthToggle++;
-        if (mouthToggle % 2 == 0) bmp = bmpShut;
-        else {
-            switch (lastMouthDir) {
-            case 0: bmp = bmpDown;  break;
-            case 1: bmp = bmpLeft;  break;
-            case 2: bmp = bmpUp;    break;
-            case 3: bmp = bmpRight; break;
-            }
-        }
+    // Restarts the clock when play (re)starts so paused time is not
+    // replayed as a burst of ticks.
+    void resyncClock() {
+        lastTime = al_get_time();
+        accumulator = 0;
+    }
 
-        posX = gridY * CELL_SIZE;
-        posY = gridX * CELL_SIZE;
+    ALLEGRO_BITMAP* mazeBitmap() const {
+        return sim.getLevel() == 3 ? bmpMapLevel3 : bmpMap;
     }
 
-    void draw() const override {
-        al_draw_bitmap(bmp, posX, posY, 0);
+    void blit(ALLEGRO_BITMAP* b, float x, float y) {
+        stats.count(b);
+        al_draw_bitmap(b, x, y, 0);
     }
 
-    void resetPosition(int gx, int gy) {
-        gridX = gx;
-        gridY = gy;
-        posX = gy * CELL_SIZE;
-        posY = gx * CELL_SIZE;
+    // Batching only pays off when the sprites share the atlas texture.
+    void holdDrawing(bool on) {
+        if (!opts.atlas) return;
+        stats.hold(on);
+        al_hold_bitmap_drawing(on);
     }
-};
 
+    void rebuildBoard() {
+        al_set_target_bitmap(boardLayer);
+        blit(mazeBitmap(), 0, 0);
 
-class Ghost {
-protected:
-    int gridX, gridY, posX, posY;
-    ALLEGRO_BITMAP* bmp;
-    int delayFrames;
-public:
-    Ghost(int gx, int gy, ALLEGRO_BITMAP* b, int delay)
-        : gridX(gx), gridY(gy),
-        posX(gy* CELL_SIZE), posY(gx* CELL_SIZE),
-        bmp(b), delayFrames(delay)
-    {
-    }
-    virtual ~Ghost() {}
-    virtual void moveAlgo(Map& M, const Pacman& p, int frameCount) = 0;
-    int getGridX() const { return gridX; }
-    int getGridY() const { return gridY; }
-    void draw() const { al_draw_bitmap(bmp, posX, posY, 0); }
-    void teleportCheck() {
-        if (gridX == 10 && gridY < 0)  gridY = 23;
-        if (gridX == 10 && gridY > 23) gridY = 0;
-    }
-    void syncPos() {
-        posX = gridY * CELL_SIZE;
-        posY = gridX * CELL_SIZE;
+        const Map& map = sim.getMap();
+        holdDrawing(true);
+        for (int i = 0; i < 24; i++)
+            for (int j = 0; j < 24; j++) {
+                char c = map.get(i, j);
+                if (c == DOT)
+                    blit(bmpDots, j * CELL_SIZE, i * CELL_SIZE);
+                else if (c == KEY && sim.isKeyAvailable())
+                    blit(bmpKey, j * CELL_SIZE, i * CELL_SIZE);
+            }
+        holdDrawing(false);
+
+        al_set_target_bitmap(al_get_backbuffer(display));
+        boardLevel = sim.getLevel();
+        boardKeys = sim.isKeyAvailable();
     }
-};
 
+    // Paints the bare maze back over the cell Pacman just emptied.
+    void eraseCell(int i, int j) {
+        al_set_target_bitmap(boardLayer);
+        stats.count(mazeBitmap());
+        al_draw_bitmap_region(mazeBitmap(),
+            j * CELL_SIZE, i * CELL_SIZE, CELL_SIZE, CELL_SIZE,
+            j * CELL_SIZE, i * CELL_SIZE, 0);
+        al_set_target_bitmap(al_get_backbuffer(display));
+    }
 
-class RandomGhost : public Ghost {
-    int lastDir;
-public:
-    RandomGhost(int gx, int gy, ALLEGRO_BITMAP* b, int delay)
-        : Ghost(gx, gy, b, delay), lastDir(-1) {
+    void updateBoard(const TickResult& r) {
+        if (sim.getLevel() != boardLevel || sim.isKeyAvailable() != boardKeys)
+            rebuildBoard();
+        else if (r.ateDot || r.ateKey)
+            eraseCell(r.eatenX, r.eatenY);
     }
-    void moveAlgo(Map& M, const Pacman& p, int frameCount) override {
-        if (frameCount < delayFrames) return;
-        teleportCheck();
-        int x = gridX, y = gridY;
-        int choice = rand() % 4;
-        if (choice == 0 && M.get(x - 1, y) != WALL && lastDir != 1) {
-            x--; lastDir = 0;
-        }
-        else if (choice == 1 && M.get(x + 1, y) != WALL && lastDir != 0) {
-            x++; lastDir = 1;
-        }
-        else if (choice == 2 && M.get(x, y + 1) != WALL && lastDir != 3) {
-            y++; lastDir = 2;
-        }
-        else if (choice == 3 && M.get(x, y - 1) != WALL && lastDir != 2) {
-            y--; lastDir = 3;
+
+    void updateHud() {
+        int currentLevel = sim.getLevel();
+        if (sim.getScore() == hudScore && currentLevel == hudLevel &&
+            sim.getLives() == hudLives && sim.hasExtraLifeAvailable() == hudLife &&
+            sim.isKeyAvailable() == hudKey)
+            return;
+        hudScore = sim.getScore();
+        hudLevel = currentLevel;
+        hudLives = sim.getLives();
+        hudLife = sim.hasExtraLifeAvailable();
+        hudKey = sim.isKeyAvailable();
+
+        const int textY = 505 - BOARD_H;
+        al_set_target_bitmap(hudLayer);
+        al_clear_to_color(al_map_rgb(0, 0, 0));
+
+        al_draw_textf(font, al_map_rgb(200, 200, 200),
+            0, textY, 0,
+            "Score: %d/%d | Level: %d | Lives: %d",
+            hudScore,
+            currentLevel == 1 ? TARGET_SCORE_LEVEL1 :
+            (currentLevel == 2 ? TARGET_SCORE_LEVEL2 : TARGET_SCORE_LEVEL3),
+            currentLevel,
+            hudLives);
+
+        if (currentLevel == 2 || currentLevel == 3) {
+            if (hudLife)
+                al_draw_text(font, al_map_rgb(0, 255, 0),
+                    200, textY, 0, "Life Available!");
+            else if (hudKey)
+                al_draw_text(font, al_map_rgb(255, 255, 0),
+                    200, textY, 0, "Find the Key!");
         }
-        else {
-           
-            if (p.getGridX() > x && M.get(x + 1, y) != WALL && lastDir != 0) { x++; lastDir = 1; }
-            else if (p.getGridX() < x && M.get(x - 1, y) != WALL && lastDir != 1) { x--; lastDir = 0; }
-            else if (p.getGridY() > y && M.get(x, y + 1) != WALL && lastDir != 3) { y++; lastDir = 2; }
-            else if (p.getGridY() < y && M.get(x, y - 1) != WALL && lastDir != 2) { y--; lastDir = 3; }
+
+        if (currentLevel == 3) {
+            al_draw_text(font, al_map_rgb(255, 0, 0),
+                350, textY, 0, "FINAL LEVEL!");
         }
-        gridX = x; gridY = y;
-        syncPos();
+
+        al_set_target_bitmap(al_get_backbuffer(display));
     }
-};
 
 
-class BlinkyGhost : public Ghost {
-    int prevX, prevY;
-    double dist(int x1, int y1, int x2, int y2) {
-        return sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-    }
-public:
-    BlinkyGhost(int gx, int gy, ALLEGRO_BITMAP* b, int delay)
-        : Ghost(gx, gy, b, delay), prevX(gx), prevY(gy) {
+    // Averages over 100 frames, including the layer updates in between.
+    void reportDrawStats() {
+        if (!opts.drawStats) return;
+        if (++statFrames < 100) return;
+        printf("draw/frame (%s): %.1f calls, %.1f texture binds, %.1f submissions\n",
+            opts.atlas ? "atlas" : "no atlas",
+            stats.calls / 100.0, stats.binds / 100.0, stats.submits / 100.0);
+        stats.clear();
+        statFrames = 0;
     }
-    void moveAlgo(Map& M, const Pacman& p, int frameCount) override {
-        if (frameCount < delayFrames) return;
-        int x = gridX, y = gridY;
-        if (x == 8 && y == 11) {
-            if (p.getGridY() <= y) y--; else y++;
-        }
-        else {
-            struct Opt { double d; int x, y; };
-            Opt opts[4] = {
-                { dist(x + 1, y, p.getGridX(), p.getGridY()), x + 1, y },
-                { dist(x, y - 1, p.getGridX(), p.getGridY()), x, y - 1 },
-                { dist(x - 1, y, p.getGridX(), p.getGridY()), x - 1, y },
-                { dist(x, y + 1, p.getGridX(), p.getGridY()), x, y + 1 }
-            };
-            double best = 1e9; int pick = -1;
-            for (int i = 0; i < 4; i++) {
-                if (opts[i].d < best &&
-                    M.get(opts[i].x, opts[i].y) != WALL &&
-                    !(opts[i].x == prevX && opts[i].y == prevY))
-                {
-                    best = opts[i].d;
-                    pick = i;
-                }
-            }
-            prevX = x; prevY = y;
-            if (pick == 0) x++;
-            else if (pick == 1) y--;
-            else if (pick == 2) x--;
-            else if (pick == 3) y++;
-        }
-        gridX = x; gridY = y;
-        teleportCheck();
-        syncPos();
-    }
-};
 
 
-class PinkyGhost : public Ghost {
-    int lastDir;
-public:
-    PinkyGhost(int gx, int gy, ALLEGRO_BITMAP* b, int delay)
-        : Ghost(gx, gy, b, delay), lastDir(-1) {
-    }
-    void moveAlgo(Map& M, const Pacman& p, int frameCount) override {
-        if (frameCount < delayFrames) return;
-        teleportCheck();
-        int x = gridX, y = gridY;
-        int tx = p.getGridX() + 2;
-        int ty = p.getGridY() + 2;
-        if (abs(tx - x) > abs(ty - y)) {
-            if (tx > x && M.get(x + 1, y) != WALL && lastDir != 0) { x++; lastDir = 1; }
-            else if (tx < x && M.get(x - 1, y) != WALL && lastDir != 1) { x--; lastDir = 0; }
+    void drawProfile() {
+        if (!showProfile || !smallFont) return;
+        double now = al_get_time();
+        if (now - profileWindowStart >= 1.0) {
+            Profiler::local().rollWindow(shownPhases);
+            profileWindowStart = now;
         }
-        else {
-            if (ty > y && M.get(x, y + 1) != WALL && lastDir != 3) { y++; lastDir = 2; }
-            else if (ty < y && M.get(x, y - 1) != WALL && lastDir != 2) { y--; lastDir = 3; }
+        ALLEGRO_COLOR c = al_map_rgb(255, 255, 255);
+        al_draw_textf(smallFont, c, 4, 4, 0, "%-8s %9s %9s %9s", "us", "min", "avg", "p99");
+        for (int p = 0; p < PH_COUNT; p++) {
+            const PhaseHistogram& h = shownPhases[p];
+            al_draw_textf(smallFont, c, 4, 14 + 10 * p, 0, "%-8s %9.1f %9.1f %9.1f", phaseName(p),
+                h.min() / 1000.0, h.avg() / 1000.0, h.quantile(0.99) / 1000.0);
         }
-        gridX = x; gridY = y;
-        syncPos();
     }
-};
 
 
-class Game {
-    ALLEGRO_DISPLAY* display = nullptr;
-    ALLEGRO_TIMER* timer = nullptr;
-    ALLEGRO_EVENT_QUEUE* evq = nullptr;
-    ALLEGRO_FONT* font = nullptr;
-
-  
-    ALLEGRO_BITMAP* bmpMap, * bmpMapLevel3, * bmpDots, * bmpKey;
-    ALLEGRO_BITMAP* bmpPac, * bmpPUp, * bmpPDown, * bmpPLeft, * bmpPRight, * bmpPShut;
-    ALLEGRO_BITMAP* bmpBlue, * bmpYellow, * bmpRed, * bmpGreen, * bmpPink;
-
-    
-    ALLEGRO_SAMPLE* sfxBegginning = nullptr;
-    ALLEGRO_SAMPLE* sfxDeath = nullptr;
-    ALLEGRO_SAMPLE* sfxSuspense = nullptr;
-    ALLEGRO_SAMPLE* sfxWaka = nullptr;
-
-    
-    ALLEGRO_SAMPLE_ID wakaLoopID;
-    ALLEGRO_SAMPLE_ID suspenseLoopID;
-
-    Map map;
-    Pacman* pac = nullptr;
-    vector<Ghost*> ghosts;
-
-    int bola = 0, score = 0, frameCount = 0;
-    bool gameover = false, exitGame = false, redraw = false, begun = false;
-    int currentLevel = 1;
-    int lives = 0;
-    bool keyAvailable = false;
-    bool hasExtraLife = false;
-
-    
-    int countDots() {
-        int cnt = 0;
-        for (int i = 0; i < 24; i++)
-            for (int j = 0; j < 24; j++)
-                if (RAW_MAP[i][j] == DOT)
-                    cnt++;
-        return cnt;
-    }
-
-    
     void stopLoopingSounds() {
-        al_stop_sample(&wakaLoopID);
-        al_stop_sample(&suspenseLoopID);
+        sounds.stopLoop();
     }
 
-   
+
     void startWakaLoop() {
-        stopLoopingSounds();
-        if (sfxWaka && (currentLevel == 1 || currentLevel == 2)) {
-            al_play_sample(sfxWaka, 0.7, 0.0, 1.0, ALLEGRO_PLAYMODE_LOOP, &wakaLoopID);
-        }
+        if (sim.getLevel() == 1 || sim.getLevel() == 2) sounds.startLoop(SFX_WAKA, 0.7f);
+        else sounds.stopLoop();
     }
 
-    
+
     void startSuspenseLoop() {
-        stopLoopingSounds();
-        if (sfxSuspense && currentLevel == 3) {
-            al_play_sample(sfxSuspense, 0.7, 0.0, 1.0, ALLEGRO_PLAYMODE_LOOP, &suspenseLoopID);
-        }
+        if (sim.getLevel() == 3) sounds.startLoop(SFX_SUSPENSE, 0.7f);
+        else sounds.stopLoop();
     }
 
-    
-    void setupLevel2() {
-        currentLevel = 2;
-        map = Map();
-        bola = countDots();
-        pac->setHasKey(false);
-        keyAvailable = true;
-        lives = 0;
-        hasExtraLife = false;
-     
-        map.set(10, 11, KEY);
-
-        delete pac;
-        for (auto g : ghosts) delete g;
-        ghosts.clear();
-
-        pac = new Pacman(17, 11,
-            bmpPac, bmpPUp, bmpPDown,
-            bmpPLeft, bmpPRight, bmpPShut,
-            &bola, &score,
-            sfxWaka        
-        );
-
-        ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-        ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-        ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-        ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
-        ghosts.push_back(new PinkyGhost(8, 9, bmpPink, 280));
-
-        
-        startWakaLoop();
+    vector<SpriteFile> spriteFiles() {
+        return {
+            { "assets/maps/map.bmp", &bmpMap },
+            { "assets/maps/map23.bmp", &bmpMapLevel3 },
+            { "assets/maps/bolas.png", &bmpDots },
+            { "assets/maps/key.png", &bmpKey },
+            { "assets/characters/pacman/pacman.png", &bmpPac },
+            { "assets/characters/pacman/pac_up.png", &bmpPUp },
+            { "assets/characters/pacman/pac_down.png", &bmpPDown },
+            { "assets/characters/pacman/pac_left.png", &bmpPLeft },
+            { "assets/characters/pacman/pac_right.png", &bmpPRight },
+            { "assets/characters/pacman/shutup.png", &bmpPShut },
+            { "assets/characters/ghosts/amarelo.png", &bmpYellow },
+            { "assets/characters/ghosts/azul.png", &bmpBlue },
+            { "assets/characters/ghosts/blinky.png", &bmpRed },
+            { "assets/characters/ghosts/gburro1.png", &bmpGreen },
+            { "assets/characters/ghosts/rosa.png", &bmpPink },
+        };
     }
 
+    vector<SoundFile> soundFiles() {
+        return {
+            { "assets/sounds/beggining.wav", &sfxBegginning },
+            { "assets/sounds/death.wav", &sfxDeath },
+            { "assets/sounds/suspense.wav", &sfxSuspense },
+            { "assets/sounds/waka.wav", &sfxWaka },
+        };
+    }
 
-    void setupLevel3() {
-        currentLevel = 3;
-        map = Map();
-        bola = countDots();
-        pac->setHasKey(false);
-        keyAvailable = true;  
-        lives = 0;
-        hasExtraLife = false;
+    // Bitmaps and samples, from ASSET_PACK when there is one that checks
+    // out, otherwise decoded from the original files on worker threads
+    // while this thread loads the font (which needs the display). Sprites
+    // end up in the atlas or, with --no-atlas, as one video bitmap each.
+    bool loadAssets() {
+        vector<SpriteFile> sprites = spriteFiles();
+        vector<SoundFile> sounds = soundFiles();
+        bool usePack = opts.usePack && al_filename_exists(ASSET_PACK);
+        if (opts.cold) {
+            if (usePack) evictFromCache(ASSET_PACK);
+            else {
+                for (const SpriteFile& f : sprites) evictFromCache(f.path);
+                for (const SoundFile& f : sounds) evictFromCache(f.path);
+            }
+        }
 
-        
-        map.set(10, 5, KEY);    
-        map.set(10, 17, KEY);   
-
-        delete pac;
-        for (auto g : ghosts) delete g;
-        ghosts.clear();
-
-        pac = new Pacman(17, 11,
-            bmpPac, bmpPUp, bmpPDown,
-            bmpPLeft, bmpPRight, bmpPShut,
-            &bola, &score,
-            nullptr    
-        );
-
-        ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-        ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-        ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-        ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
-        ghosts.push_back(new PinkyGhost(8, 9, bmpPink, 280));
-        ghosts.push_back(new RandomGhost(7, 11, bmpYellow, 350)); 
+        auto t0 = chrono::steady_clock::now();
+        vector<ALLEGRO_BITMAP*> images;
+        bool ok;
+        if (usePack) {
+            loadMode = "pack";
+            ok = pack.open(ASSET_PACK) && pack.load(sprites, images, sounds);
+            if (ok) loadFont();
+            else {
+                cerr << "Loading the asset files instead of " << ASSET_PACK << "\n";
+                pack.close();
+                usePack = false;
+            }
+        }
+        if (!usePack) {
+            loadMode = "files";
+            int n = opts.loadThreads > 0 ? opts.loadThreads : (int)thread::hardware_concurrency();
+            ParallelLoader loader;
+            loader.start(sprites, images, sounds, n);
+            loadFont();
+            ok = loader.join();
+        }
+        if (!ok || !font) {
+            for (auto b : images) al_destroy_bitmap(b);
+            return false;
+        }
 
-        
-        startSuspenseLoop();
+        if (opts.atlas) {
+            if (!atlas.build(sprites, images)) return false;
+        }
+        else {
+            for (size_t i = 0; i < sprites.size(); i++) {
+                al_convert_bitmap(images[i]);
+                *sprites[i].slot = images[i];
+            }
+        }
+        loadMs = msSince(t0);
+        return true;
     }
 
-    
-    void resetEntities() {
-        pac->resetPosition(17, 11);
-
-        for (auto g : ghosts) delete g;
-        ghosts.clear();
-
-        if (currentLevel == 1) {
-            ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-            ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-            ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-            ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
+    void loadFont() {
+        smallFont = al_create_builtin_font();
+        font = al_load_ttf_font("/usr/share/fonts/truetype/liberation/LiberationMono-Bold.ttf", 28, 0);
+        if (!font) {
+            font = al_load_ttf_font("C:/Windows/Fonts/OCRAEXT.ttf", 28, 0);
+            if (!font) cerr << "ERROR: failed to load any TTF font\n";
         }
-        else if (currentLevel == 2) {
-            ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-            ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-            ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-            ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
-            ghosts.push_back(new PinkyGhost(8, 9, bmpPink, 280));
+    }
+
+    void flip() {
+        {
+            PhaseTimer t(PH_FLIP);
+            al_flip_display();
         }
-        else if (currentLevel == 3) {
-            ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-            ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-            ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-            ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
-            ghosts.push_back(new PinkyGhost(8, 9, bmpPink, 280));
-            ghosts.push_back(new RandomGhost(7, 11, bmpYellow, 350));
+        if (!firstFrameShown) {
+            firstFrameShown = true;
+            if (opts.startupReport)
+                printf("startup: %.1f ms to first frame, assets %.1f ms (%s, %s cache)\n",
+                    msSince(processStart), loadMs, loadMode, opts.cold ? "cold" : "warm");
         }
     }
 
 public:
+    explicit Game(const GameOptions& o)
+        : opts(o), sim(o.seed), replayer(o.replay ? *o.replay : log), turns(o.turnBuffer) {
+        log.begin(o.seed);
+        sim.setProfiled(true);
+    }
+
+    // --pack-assets: decodes every asset once and writes them to `path`.
+    // Needs no display.
+    bool packAssets(const char* path) {
+        if (!al_init() || !al_install_audio() || !al_init_acodec_addon() || !al_init_image_addon()) {
+            cerr << "ERROR: Allegro initialisation failed\n";
+            return false;
+        }
+        return writeAssetPack(path, spriteFiles(), soundFiles());
+    }
+
     bool loadBMP(const char* path, ALLEGRO_BITMAP*& bmp) {
         bmp = al_load_bitmap(path);
         if (!bmp) {
@@ -513,7 +482,8 @@ public:
         if (!al_init_acodec_addon()) {               
             cerr << "ERROR: al_init_acodec_addon() failed\n"; return false;
         }
-        if (!al_reserve_samples(10)) {                
+        // No voices of its own: only the default mixer, for SoundMixer's pool.
+        if (!al_reserve_samples(0)) {
             cerr << "ERROR: al_reserve_samples() failed\n"; return false;
         }
 
@@ -521,63 +491,35 @@ public:
         al_init_font_addon();
         al_init_ttf_addon();
 
+        al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
         display = al_create_display(SCREEN_W, SCREEN_H);
         if (!display) { cerr << "ERROR: al_create_display() failed\n"; return false; }
-        timer = al_create_timer(1.0 / FPS);
+
+        double renderRate = opts.renderRate;
+        if (renderRate <= 0) renderRate = al_get_display_refresh_rate(display);
+        if (renderRate <= 0) renderRate = 60;
+        simDt = 1.0 / opts.tickRate;
+        timer = al_create_timer(1.0 / renderRate);
         if (!timer) { cerr << "ERROR: al_create_timer() failed\n";   return false; }
         evq = al_create_event_queue();
         if (!evq) { cerr << "ERROR: al_create_event_queue() failed\n"; return false; }
 
-       
-        if (!loadBMP("assets/maps/map.bmp", bmpMap))  return false;
-        if (!loadBMP("assets/maps/map23.bmp", bmpMapLevel3))  return false;
-        if (!loadBMP("assets/maps/bolas.png", bmpDots)) return false;
-        if (!loadBMP("assets/maps/key.png", bmpKey))  return false;
-        if (!loadBMP("assets/characters/pacman/pacman.png", bmpPac))   return false;
-        if (!loadBMP("assets/characters/pacman/pac_up.png", bmpPUp))   return false;
-        if (!loadBMP("assets/characters/pacman/pac_down.png", bmpPDown)) return false;
-        if (!loadBMP("assets/characters/pacman/pac_left.png", bmpPLeft)) return false;
-        if (!loadBMP("assets/characters/pacman/pac_right.png", bmpPRight))return false;
-        if (!loadBMP("assets/characters/pacman/shutup.png", bmpPShut)) return false;
-        if (!loadBMP("assets/characters/ghosts/amarelo.png", bmpYellow)) return false;
-        if (!loadBMP("assets/characters/ghosts/azul.png", bmpBlue))   return false;
-        if (!loadBMP("assets/characters/ghosts/blinky.png", bmpRed))    return false;
-        if (!loadBMP("assets/characters/ghosts/gburro1.png", bmpGreen)) return false;
-        if (!loadBMP("assets/characters/ghosts/rosa.png", bmpPink))   return false;
+        if (!loadAssets()) return false;
 
-        
-        sfxBegginning = al_load_sample("assets/sounds/beggining.wav");
-        if (!sfxBegginning) { cerr << "Failed to load beggining.wav\n"; return false; }
-        sfxDeath = al_load_sample("assets/sounds/death.wav");
-        if (!sfxDeath) { cerr << "Failed to load death.wav\n"; return false; }
-        sfxSuspense = al_load_sample("assets/sounds/suspense.wav");
-        if (!sfxSuspense) { cerr << "Failed to load suspense.wav\n"; return false; }
-        sfxWaka = al_load_sample("assets/sounds/waka.wav");
-        if (!sfxWaka) { cerr << "Failed to load waka.wav\n"; return false; }
+        ALLEGRO_SAMPLE* samples[SFX_COUNT] = { sfxBegginning, sfxDeath, sfxWaka, sfxSuspense };
+        if (!mixer.open(samples)) { cerr << "ERROR: failed to create the sound voices\n"; return false; }
 
         
-        font = al_load_ttf_font("/usr/share/fonts/truetype/liberation/LiberationMono-Bold.ttf", 28, 0);
-        if (!font) {
-            font = al_load_ttf_font("C:/Windows/Fonts/OCRAEXT.ttf", 28, 0);
-            if (!font) {
-                cerr << "ERROR: failed to load any TTF font\n";
-                return false;
-            }
-        }
+        ghostBmp[GHOST_YELLOW] = bmpYellow;
+        ghostBmp[GHOST_BLUE] = bmpBlue;
+        ghostBmp[GHOST_RED] = bmpRed;
+        ghostBmp[GHOST_GREEN] = bmpGreen;
+        ghostBmp[GHOST_PINK] = bmpPink;
 
-        
-        bola = countDots();
-        pac = new Pacman(17, 11,
-            bmpPac, bmpPUp, bmpPDown,
-            bmpPLeft, bmpPRight, bmpPShut,
-            &bola, &score,
-            sfxWaka    
-        );
-
-        ghosts.push_back(new RandomGhost(8, 11, bmpYellow, 0));
-        ghosts.push_back(new RandomGhost(9, 11, bmpBlue, 70));
-        ghosts.push_back(new RandomGhost(10, 11, bmpRed, 140));
-        ghosts.push_back(new BlinkyGhost(11, 11, bmpGreen, 210));
+        boardLayer = al_create_bitmap(SCREEN_W, BOARD_H);
+        hudLayer = al_create_bitmap(SCREEN_W, SCREEN_H - BOARD_H);
+        if (!boardLayer || !hudLayer) { cerr << "ERROR: failed to create layer bitmaps\n"; return false; }
+        rebuildBoard();
 
        
         al_register_event_source(evq, al_get_display_event_source(display));
@@ -587,169 +529,211 @@ public:
         al_start_timer(timer);
 
         
-        if (sfxBegginning)
-            al_play_sample(sfxBegginning, 1.0, 0.0, 1.0, ALLEGRO_PLAYMODE_ONCE, nullptr);
+        sounds.play(SFX_BEGINNING, 1.0f);
 
         startWakaLoop();
 
         return true;
     }
 
+    // One fixed simulation tick plus its sounds. Level changes, deaths
+    // and the end of the game switch state and schedule what comes next
+    // instead of sleeping.
+    void simTick() {
+        int level = sim.getLevel();
+        double now = al_get_time();
+        int input = opts.replay ? replayer.input(sim.getFrameCount() + 1)
+            : opts.autoplay ? autoplayer.choose(sim) : turns.take(sim, now);
+        history.push(sim);
+        log.record(sim, input);
+        int fromX = sim.getPacman().getGridX(), fromY = sim.getPacman().getGridY();
+        TickResult r = sim.step(input);
+        log.note(sim);
+        bool moved = sim.getPacman().getGridX() != fromX || sim.getPacman().getGridY() != fromY;
+        latency.ticked(moved ? sim.getPacman().getIntent() : DIR_NONE, now);
+        {
+            PhaseTimer t(PH_BOARD);
+            updateBoard(r);
+        }
+
+        // Level 3 has no per-dot waka, only the suspense loop.
+        if ((r.ateDot || r.ateKey) && level != 3)
+            sounds.play(SFX_WAKA, 0.7f);
+
+        if (r.levelUp) {
+            if (sim.getLevel() == 3) startSuspenseLoop();
+            else startWakaLoop();
+            state = STATE_PAUSE;
+            after(LEVEL_PAUSE, EV_PLAY);
+        }
+        else if (r.won) {
+            state = STATE_WON;
+            after(WON_PAUSE, EV_EXIT);
+        }
+        else if (r.lostLife || r.gameOver) {
+            stopLoopingSounds();
+            sounds.play(SFX_DEATH, 1.0f);
+            if (r.lostLife) {
+                state = STATE_PAUSE;
+                after(DEATH_PAUSE, EV_RESUME_AFTER_DEATH);
+            }
+            else {
+                state = STATE_GAME_OVER;
+                after(GAME_OVER_PAUSE, EV_EXIT);
+            }
+        }
+        // A log of a session that was quit mid-game ends here.
+        else if (opts.replay && sim.getFrameCount() >= opts.replay->getOutcome().frames) {
+            stopLoopingSounds();
+            state = STATE_GAME_OVER;
+            after(GAME_OVER_PAUSE, EV_EXIT);
+        }
+    }
+
+    // Never blocks for longer than one render-timer period, so input and
+    // window events are handled promptly in every state.
     void run() {
+        resyncClock();
+        after(READY_PAUSE, EV_PLAY);
         while (!exitGame) {
             ALLEGRO_EVENT ev;
             al_wait_for_event(evq, &ev);
 
             if (ev.type == ALLEGRO_EVENT_TIMER) {
-                frameCount++;
-                pac->update(map);
-                for (auto g : ghosts) g->moveAlgo(map, *pac, frameCount);
-
-                
-                if ((currentLevel == 2 || currentLevel == 3) && pac->getHasKey()) {
-                    hasExtraLife = true;
-                    pac->setHasKey(false);
-                    keyAvailable = (currentLevel == 3 && map.get(10, 5) == KEY) ||
-                        (currentLevel == 3 && map.get(10, 17) == KEY);
-                    lives = 1;
-                }
-
-                
-                if (score >= TARGET_SCORE_LEVEL1 && currentLevel == 1) {
-                    setupLevel2();
-                    al_rest(1.0);
-                    continue;
-                }
-                else if (score >= TARGET_SCORE_LEVEL2 && currentLevel == 2) {
-                    setupLevel3();
-                    al_rest(1.0);
-                    continue;
-                }
-
-                
-                if (bola == 0 && currentLevel == 3) {
-                    al_draw_bitmap(bmpMapLevel3, 0, 0, 0);
-                    al_flip_display();
-                    al_rest(4.0);
-                    exitGame = true;
-                    continue;
+                {
+                    PhaseTimer t(PH_EVENTS);
+                    int te;
+                    while (timers.popDue(nowMs(), te)) onTimedEvent(te);
                 }
 
-                
-                for (auto g : ghosts) {
-                    if (g->getGridX() == pac->getGridX() &&
-                        g->getGridY() == pac->getGridY())
-                    {
-                        if (hasExtraLife) {
-                            
-                            hasExtraLife = false;
-                            lives = 0;
-                            resetEntities();
-
-           
-                            stopLoopingSounds();
-                            if (sfxDeath)
-                                al_play_sample(sfxDeath, 1.0, 0.0, 1.0, ALLEGRO_PLAYMODE_ONCE, nullptr);
-
-                            
-                            al_rest(1.0);
-                            if (currentLevel == 1 || currentLevel == 2) {
-                                startWakaLoop();
-                            }
-                            else if (currentLevel == 3) {
-                                startSuspenseLoop();
-                            }
-                        }
-                        else {
-                            
-                            stopLoopingSounds();
-                            if (sfxDeath)
-                                al_play_sample(sfxDeath, 1.0, 0.0, 1.0, ALLEGRO_PLAYMODE_ONCE, nullptr);
-                            gameover = true;
-                        }
+                if (state == STATE_PLAY) {
+                    double now = al_get_time();
+                    accumulator += min(now - lastTime, 0.25);
+                    lastTime = now;
+                    while (accumulator >= simDt && state == STATE_PLAY) {
+                        accumulator -= simDt;
+                        simTick();
                     }
                 }
+                mixer.flush(sounds);
                 redraw = true;
             }
             else if (ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
                 exitGame = true;
             }
             else if (ev.type == ALLEGRO_EVENT_KEY_DOWN) {
-                pac->handleKey(ev.keyboard.keycode);
+                PhaseTimer t(PH_EVENTS);
+                int dir = keyToDir(ev.keyboard.keycode);
+                if (dir != DIR_NONE) {
+                    turns.push(dir, ev.keyboard.timestamp);
+                    if (state == STATE_PLAY) latency.pressed(dir, ev.keyboard.timestamp);
+                }
                 if (ev.keyboard.keycode == ALLEGRO_KEY_ESCAPE)
                     exitGame = true;
+                if (ev.keyboard.keycode == ALLEGRO_KEY_BACKSPACE)
+                    rewind();
+                if (ev.keyboard.keycode == ALLEGRO_KEY_F3) {
+                    showProfile = !showProfile;
+                    if (showProfile) Profiler::enable(true);
+                }
             }
 
-            if (redraw && al_is_event_queue_empty(evq)) {
+            if (redraw && al_is_event_queue_empty(evq) && state == STATE_WON) {
+                redraw = false;
+                blit(bmpMapLevel3, 0, 0);
+                flip();
+            }
+            else if (redraw && al_is_event_queue_empty(evq)) {
                 redraw = false;
-                al_clear_to_color(al_map_rgb(0, 0, 0));
 
-                
-                if (currentLevel == 3) {
-                    al_draw_bitmap(bmpMapLevel3, 0, 0, 0);
+                {
+                    PhaseTimer t(PH_BOARD);
+                    blit(boardLayer, 0, 0);
                 }
-                else {
-                    al_draw_bitmap(bmpMap, 0, 0, 0);
+                {
+                    PhaseTimer t(PH_HUD);
+                    updateHud();
+                    blit(hudLayer, 0, BOARD_H);
                 }
 
-                
-                for (int i = 0; i < 24; i++)
-                    for (int j = 0; j < 24; j++) {
-                        char c = map.get(i, j);
-                        if (c == DOT)
-                            al_draw_bitmap(bmpDots, j * CELL_SIZE, i * CELL_SIZE, 0);
-                        else if (c == KEY && keyAvailable)
-                            al_draw_bitmap(bmpKey, j * CELL_SIZE, i * CELL_SIZE, 0);
+                {
+                    PhaseTimer t(PH_SPRITES);
+                    float alpha = state == STATE_PLAY ? (float)(accumulator / simDt) : 1.0f;
+                    const Pacman& pac = sim.getPacman();
+                    holdDrawing(true);
+                    blit(pacmanBitmap(),
+                        lerpPos(pac.getPrevPosX(), pac.getPosX(), alpha),
+                        lerpPos(pac.getPrevPosY(), pac.getPosY(), alpha));
+                    const GhostSet& ghosts = sim.getGhosts();
+                    for (int i = 0; i < ghosts.size(); i++) {
+                        GhostView g = ghosts.get(i);
+                        blit(ghostBmp[g.getSprite()],
+                            lerpPos(g.getPrevPosX(), g.getPosX(), alpha),
+                            lerpPos(g.getPrevPosY(), g.getPosY(), alpha));
                     }
-
-                pac->draw();
-                for (auto g : ghosts) g->draw();
-
-                al_draw_textf(font, al_map_rgb(200, 200, 200),
-                    0, 505, 0,
-                    "Score: %d/%d | Level: %d | Lives: %d",
-                    score,
-                    currentLevel == 1 ? TARGET_SCORE_LEVEL1 :
-                    (currentLevel == 2 ? TARGET_SCORE_LEVEL2 : TARGET_SCORE_LEVEL3),
-                    currentLevel,
-                    lives);
-
-                if (currentLevel == 2 || currentLevel == 3) {
-                    if (hasExtraLife)
-                        al_draw_text(font, al_map_rgb(0, 255, 0),
-                            200, 505, 0, "Life Available!");
-                    else if (keyAvailable)
-                        al_draw_text(font, al_map_rgb(255, 255, 0),
-                            200, 505, 0, "Find the Key!");
+                    holdDrawing(false);
                 }
+                drawProfile();
 
-                if (currentLevel == 3) {
-                    al_draw_text(font, al_map_rgb(255, 0, 0),
-                        350, 505, 0, "FINAL LEVEL!");
-                }
+                flip();
+                reportDrawStats();
+            }
+        }
+    }
 
-                al_flip_display();
+    // Backspace: back REWIND_SECONDS of play, out of a death or a game over
+    // too. The input log is cut back to match, so the saved session is the
+    // game as it was finally played.
+    void rewind() {
+        if (opts.replay || state == STATE_READY || state == STATE_WON) return;
+        if (!history.rewind(sim, (int)(REWIND_SECONDS * opts.tickRate) - 1)) return;
+        log.truncate(sim.getFrameCount());
+        log.note(sim);
+        timers.clear();
+        state = STATE_PLAY;
+        turns.clear();
+        rebuildBoard();
+        if (sim.getLevel() == 3) startSuspenseLoop();
+        else startWakaLoop();
+        resyncClock();
+    }
 
-                if (!begun) {
-                    al_rest(3.1);
-                    begun = true;
-                }
-                if (gameover) {
-                    al_rest(2.0);
-                    exitGame = true;
-                }
-            }
+    // --turn-report: how long the keyboard turns of this session took.
+    void reportTurns() {
+        if (!opts.turnReport || opts.replay || opts.autoplay) return;
+        char label[64];
+        snprintf(label, sizeof(label), "input latency (buffer %.0f ms)", opts.turnBuffer * 1000);
+        latency.print(stdout, label);
+    }
+
+    // Saves the session's input log, or after --watch says whether the
+    // replay ended where the recording did. False on a failed save or a
+    // diverging replay.
+    bool finishLog() {
+        if (opts.replay) {
+            bool same = log.getOutcome() == opts.replay->getOutcome();
+            cout << "replay " << (same ? "matches" : "DIVERGES from") << " the recording\n";
+            return same;
+        }
+        if (!opts.recordPath) return true;
+        if (!log.save(opts.recordPath)) {
+            cerr << "ERROR: cannot write " << opts.recordPath << "\n";
+            return false;
         }
+        cout << "session recorded to " << opts.recordPath << " (" << log.getChanges()
+            << " turns, " << log.getBytes() << " bytes)\n";
+        return true;
     }
 
     void cleanup() {
-        delete pac;
-        for (auto g : ghosts) delete g;
-
         al_destroy_display(display);
         al_destroy_timer(timer);
         al_destroy_event_queue(evq);
         al_destroy_font(font);
+        al_destroy_font(smallFont);
+
+        al_destroy_bitmap(boardLayer);
+        al_destroy_bitmap(hudLayer);
 
         
         al_destroy_bitmap(bmpMap);
@@ -767,23 +751,1112 @@ public:
         al_destroy_bitmap(bmpRed);
         al_destroy_bitmap(bmpGreen);
         al_destroy_bitmap(bmpPink);
+        atlas.destroy();
 
         
+        mixer.close();
         al_destroy_sample(sfxBegginning);
         al_destroy_sample(sfxDeath);
         al_destroy_sample(sfxSuspense);
         al_destroy_sample(sfxWaka);
+        pack.close();
     }
 };
 
-int main() {
-    srand((unsigned)time(nullptr));
-    Game game;
+// --big-maze: a BigWorld on screen. The camera follows Pacman and only the
+// cells and ghosts under it are drawn, walls as a plain tile since there
+// is no maze bitmap to cut them from.
+class BigMazeGame {
+    BigWorld world;
+    Camera cam{ SCREEN_W, BOARD_H };
+    ALLEGRO_DISPLAY* display = nullptr;
+    ALLEGRO_TIMER* timer = nullptr;
+    ALLEGRO_EVENT_QUEUE* evq = nullptr;
+    ALLEGRO_FONT* font = nullptr;
+    ALLEGRO_BITMAP* wallTile = nullptr;
+    ALLEGRO_BITMAP* bmpDots = nullptr;
+    ALLEGRO_BITMAP* bmpPac = nullptr;
+    ALLEGRO_BITMAP* ghostBmp[GHOST_SPRITE_COUNT] = {};
+    int pendingInput = DIR_NONE;
+
+    void draw() {
+        al_clear_to_color(al_map_rgb(0, 0, 0));
+        const BigMaze& maze = world.getMaze();
+        cam.follow(world.getPacY() * CELL_SIZE + CELL_SIZE / 2, world.getPacX() * CELL_SIZE + CELL_SIZE / 2,
+            maze.getCols() * CELL_SIZE, maze.getRows() * CELL_SIZE);
+
+        al_set_clipping_rectangle(0, 0, SCREEN_W, BOARD_H);
+        al_hold_bitmap_drawing(true);
+        world.forEachVisibleCell(cam, [&](int x, int y, char c) {
+            al_draw_bitmap(c == WALL ? wallTile : bmpDots, y * CELL_SIZE - cam.x, x * CELL_SIZE - cam.y, 0);
+            });
+        al_draw_bitmap(bmpPac, world.getPacY() * CELL_SIZE - cam.x, world.getPacX() * CELL_SIZE - cam.y, 0);
+        world.forEachVisibleGhost(cam, [&](const BigWorld::Ghost& g) {
+            al_draw_bitmap(ghostBmp[g.sprite], g.y * CELL_SIZE - cam.x, g.x * CELL_SIZE - cam.y, 0);
+            });
+        al_hold_bitmap_drawing(false);
+        al_set_clipping_rectangle(0, 0, SCREEN_W, SCREEN_H);
+
+        al_draw_textf(font, al_map_rgb(200, 200, 200), 4, BOARD_H + 8, 0,
+            "%dx%d  score %d  caught %d", maze.getRows(), maze.getCols(), world.getScore(), world.getDeaths());
+        al_draw_textf(font, al_map_rgb(200, 200, 200), 4, BOARD_H + 24, 0,
+            "chunks %d/%d  ghosts %d active of %d  %zu KB", maze.madeChunks(),
+            maze.getChunkRows() * maze.getChunkCols(), world.activeGhosts(), world.ghostCount(),
+            maze.bytes() / 1024);
+        al_flip_display();
+    }
+
+public:
+    BigMazeGame(int size, uint64_t seed) : world(size, seed) {}
+
+    bool init(double tickRate) {
+        if (!al_init() || !al_install_keyboard() || !al_init_image_addon() || !al_init_font_addon()) {
+            cerr << "ERROR: Allegro initialisation failed\n";
+            return false;
+        }
+        display = al_create_display(SCREEN_W, SCREEN_H);
+        if (!display) { cerr << "ERROR: al_create_display() failed\n"; return false; }
+        timer = al_create_timer(1.0 / tickRate);
+        evq = al_create_event_queue();
+        font = al_create_builtin_font();
+        if (!timer || !evq || !font) { cerr << "ERROR: failed to create the timer, queue or font\n"; return false; }
+
+        const char* ghostFiles[GHOST_SPRITE_COUNT] = {
+            "assets/characters/ghosts/amarelo.png", "assets/characters/ghosts/azul.png",
+            "assets/characters/ghosts/blinky.png", "assets/characters/ghosts/gburro1.png",
+            "assets/characters/ghosts/rosa.png",
+        };
+        bmpDots = al_load_bitmap("assets/maps/bolas.png");
+        bmpPac = al_load_bitmap("assets/characters/pacman/pacman.png");
+        bool ok = bmpDots && bmpPac;
+        for (int i = 0; i < GHOST_SPRITE_COUNT; i++) ok = (ghostBmp[i] = al_load_bitmap(ghostFiles[i])) && ok;
+        if (!ok) { cerr << "ERROR: failed to load the sprites\n"; return false; }
+
+        wallTile = al_create_bitmap(CELL_SIZE, CELL_SIZE);
+        if (!wallTile) { cerr << "ERROR: failed to create the wall tile\n"; return false; }
+        al_set_target_bitmap(wallTile);
+        al_clear_to_color(al_map_rgb(33, 33, 222));
+        al_set_target_bitmap(al_get_backbuffer(display));
+
+        al_register_event_source(evq, al_get_display_event_source(display));
+        al_register_event_source(evq, al_get_timer_event_source(timer));
+        al_register_event_source(evq, al_get_keyboard_event_source());
+        al_start_timer(timer);
+        return true;
+    }
+
+    void run() {
+        bool done = false, redraw = true;
+        while (!done) {
+            ALLEGRO_EVENT ev;
+            al_wait_for_event(evq, &ev);
+            if (ev.type == ALLEGRO_EVENT_TIMER) {
+                world.step(pendingInput);
+                pendingInput = DIR_NONE;
+                redraw = true;
+            }
+            else if (ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
+                done = true;
+            }
+            else if (ev.type == ALLEGRO_EVENT_KEY_DOWN) {
+                int k = ev.keyboard.keycode;
+                if (k == ALLEGRO_KEY_UP) pendingInput = DIR_UP;
+                else if (k == ALLEGRO_KEY_DOWN) pendingInput = DIR_DOWN;
+                else if (k == ALLEGRO_KEY_LEFT) pendingInput = DIR_LEFT;
+                else if (k == ALLEGRO_KEY_RIGHT) pendingInput = DIR_RIGHT;
+                else if (k == ALLEGRO_KEY_ESCAPE) done = true;
+            }
+            if (redraw && al_is_event_queue_empty(evq)) {
+                redraw = false;
+                draw();
+            }
+        }
+    }
+
+    void cleanup() {
+        for (ALLEGRO_BITMAP* b : ghostBmp) al_destroy_bitmap(b);
+        al_destroy_bitmap(bmpPac);
+        al_destroy_bitmap(bmpDots);
+        al_destroy_bitmap(wallTile);
+        al_destroy_font(font);
+        al_destroy_event_queue(evq);
+        al_destroy_timer(timer);
+        al_destroy_display(display);
+    }
+};
+
+// Runs the simulation flat out with no Allegro at all and reports the
+// throughput. Pacman wanders with a new random intent every few ticks;
+// each finished game restarts on the next seed, so a run is reproducible.
+static int runHeadlessBench(long long ticks, uint64_t seed) {
+    Simulation sim(seed);
+    sim.setProfiled(true);
+    Rng inputRng(~seed);
+    int input = DIR_NONE;
+    long long games = 0;
+
+    auto t0 = chrono::steady_clock::now();
+    for (long long i = 0; i < ticks; i++) {
+        if (i % 8 == 0) input = (int)inputRng.below(4) + 1;
+        sim.step(input);
+        if (sim.isFinished()) {
+            sim.reset(seed + games + 1);
+            games++;
+        }
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    printf("headless: %lld ticks, %lld games in %.3f s = %.2f M ticks/s\n",
+        ticks, games, secs, ticks / secs / 1e6);
+    return 0;
+}
+
+// The chase step BlinkyGhost used before PathTable: try the four
+// neighbours, keep the non-wall one closest to the target in a straight
+// line, never step back onto the previous cell.
+static int greedyChaseStep(const Map& M, int& x, int& y, int& prevX, int& prevY, int tx, int ty) {
+    int nx[4] = { x + 1, x, x - 1, x };
+    int ny[4] = { y, y - 1, y, y + 1 };
+    double best = 1e9; int pick = -1;
+    for (int i = 0; i < 4; i++) {
+        double d = sqrt((double)(tx - nx[i]) * (tx - nx[i]) + (double)(ty - ny[i]) * (ty - ny[i]));
+        if (d < best && M.get(nx[i], ny[i]) != WALL && !(nx[i] == prevX && ny[i] == prevY)) {
+            best = d;
+            pick = i;
+        }
+    }
+    prevX = x; prevY = y;
+    if (pick >= 0) { x = nx[pick]; y = ny[pick]; }
+    return pick;
+}
+
+// Ghost-AI cost of the greedy step, the next-hop table and the junction
+// graph the ghosts use now: ns per chase decision over the same random
+// (ghost, Pacman) cell pairs, what that means for a tick with five chasing
+// ghosts, how often each reaches a standing target within 100 steps, and
+// what the table and the graph cost in memory.
+static int runGhostBench(long long decisions, uint64_t seed) {
+    auto t0 = chrono::steady_clock::now();
+    const PathTable& paths = PathTable::classic();
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    Map map;
+    Rng rng(seed);
+
+    const int PAIRS = 4096;
+    vector<int> fx(PAIRS), fy(PAIRS), tx(PAIRS), ty(PAIRS);
+    for (int i = 0; i < PAIRS; i++) {
+        int a = (int)rng.below(paths.cellCount()), b = (int)rng.below(paths.cellCount());
+        fx[i] = paths.cellRow(a); fy[i] = paths.cellCol(a);
+        tx[i] = paths.cellRow(b); ty[i] = paths.cellCol(b);
+    }
+
+    long long sink = 0;
+    t0 = chrono::steady_clock::now();
+    for (long long k = 0; k < decisions; k++) {
+        int i = (int)(k & (PAIRS - 1));
+        int x = fx[i], y = fy[i], px = -1, py = -1;
+        sink += greedyChaseStep(map, x, y, px, py, tx[i], ty[i]);
+    }
+    double greedyNs = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / decisions;
+
+    t0 = chrono::steady_clock::now();
+    for (long long k = 0; k < decisions; k++) {
+        int i = (int)(k & (PAIRS - 1));
+        sink += paths.nextDir(fx[i], fy[i], tx[i], ty[i]);
+    }
+    double tableNs = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / decisions;
+
+    t0 = chrono::steady_clock::now();
+    const JunctionGraph& graph = JunctionGraph::classic();
+    double graphBuildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    t0 = chrono::steady_clock::now();
+    for (long long k = 0; k < decisions; k++) {
+        int i = (int)(k & (PAIRS - 1));
+        sink += graph.nextDir(fx[i], fy[i], tx[i], ty[i]);
+    }
+    double graphNs = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count() / decisions;
+
+    int greedyHits = 0, tableHits = 0, graphHits = 0;
+    for (int i = 0; i < PAIRS; i++) {
+        int x = fx[i], y = fy[i], px = -1, py = -1;
+        for (int s = 0; s < 100 && !(x == tx[i] && y == ty[i]); s++)
+            greedyChaseStep(map, x, y, px, py, tx[i], ty[i]);
+        greedyHits += (x == tx[i] && y == ty[i]);
+
+        x = fx[i]; y = fy[i];
+        for (int s = 0; s < 100 && !(x == tx[i] && y == ty[i]); s++)
+            PathTable::applyDir(x, y, paths.nextDir(x, y, tx[i], ty[i]));
+        tableHits += (x == tx[i] && y == ty[i]);
+
+        x = fx[i]; y = fy[i];
+        for (int s = 0; s < 100 && !(x == tx[i] && y == ty[i]); s++)
+            PathTable::applyDir(x, y, graph.nextDir(x, y, tx[i], ty[i]));
+        graphHits += (x == tx[i] && y == ty[i]);
+    }
+
+    printf("ghost AI: %lld decisions per variant (checksum %lld)\n", decisions, sink);
+    printf("  greedy sqrt : %6.2f ns/decision, %7.2f ns/tick for 5 ghosts, reaches target %5.1f%%\n",
+        greedyNs, greedyNs * 5, 100.0 * greedyHits / PAIRS);
+    printf("  next-hop    : %6.2f ns/decision, %7.2f ns/tick for 5 ghosts, reaches target %5.1f%%\n",
+        tableNs, tableNs * 5, 100.0 * tableHits / PAIRS);
+    printf("  junctions   : %6.2f ns/decision, %7.2f ns/tick for 5 ghosts, reaches target %5.1f%%\n",
+        graphNs, graphNs * 5, 100.0 * graphHits / PAIRS);
+    printf("  table: %d walkable cells, %zu bytes, built in %.2f ms\n",
+        paths.cellCount(), paths.bytes(), buildMs);
+    printf("  graph: %d nodes, %zu bytes, built in %.2f ms; chasers only decide on nodes\n",
+        graph.nodeCount(), graph.bytes(), graphBuildMs);
+    return 0;
+}
+
+// Plays `games` full games at 1, 2, 4 ... `threads` workers, reports games/s
+// and scaling efficiency against one worker, then summarises the results of
+// the widest run. Per-game rows go to `csvPath` when one is given.
+static int runBatch(int games, int threads, uint64_t seed, const char* csvPath) {
+    vector<int> counts;
+    for (int t = 1; t < threads; t *= 2) counts.push_back(t);
+    counts.push_back(threads);
+
+    vector<GameResult> results;
+    double baseRate = 0;
+    printf("batch: %d games, seed %llu\n", games, (unsigned long long)seed);
+    printf("%8s %10s %12s %11s %8s\n", "threads", "seconds", "games/s", "efficiency", "steals");
+    for (int t : counts) {
+        BatchRunner runner(t);
+        runner.setProfiled(true);
+        auto t0 = chrono::steady_clock::now();
+        results = runner.run(games, seed);
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        double rate = games / secs;
+        if (t == 1) baseRate = rate;
+        printf("%8d %10.3f %12.1f %10.1f%% %8lld\n",
+            t, secs, rate, 100.0 * rate / (baseRate * t), runner.getSteals());
+    }
+
+    long long scoreSum = 0, frameSum = 0;
+    int levels[4] = {}, ends[3] = {};
+    for (const GameResult& r : results) {
+        scoreSum += r.score;
+        frameSum += r.frames;
+        levels[r.level]++;
+        ends[r.end]++;
+    }
+    printf("avg score %.1f, avg frames %.1f\n",
+        (double)scoreSum / games, (double)frameSum / games);
+    printf("reached level 1/2/3: %d/%d/%d\n", levels[1], levels[2], levels[3]);
+    printf("caught %d, won %d, timeout %d\n", ends[END_CAUGHT], ends[END_WON], ends[END_TIMEOUT]);
+
+    if (csvPath) {
+        FILE* f = fopen(csvPath, "w");
+        if (!f) { cerr << "ERROR: cannot write " << csvPath << "\n"; return -1; }
+        fprintf(f, "seed,score,level,frames,end,killer\n");
+        for (const GameResult& r : results)
+            fprintf(f, "%llu,%d,%d,%d,%s,%s\n", (unsigned long long)r.seed,
+                r.score, r.level, r.frames, gameEndName(r.end), ghostKindName(r.killer));
+        fclose(f);
+    }
+    return 0;
+}
+
+// Ghost movement cost as the ghost count grows from the game's handful
+// to thousands: ns per ghost per tick for GhostSet::move() with an even
+// mix of behaviours, all released, spread over random walkable cells and
+// chasing a Pacman who jumps to a new cell every 8 ticks. Flat is good.
+static int runGhostScaling(long long moves, uint64_t seed) {
+    const JunctionGraph& graph = JunctionGraph::classic();
+    Map map;
+    Rng rng(seed);
+    const int counts[] = { 4, 6, 16, 64, 256, 1024, 4096, 16384 };
+
+    printf("ghost scaling: ~%lld ghost moves per row\n", moves);
+    printf("  %6s %10s %12s %14s\n", "ghosts", "ticks", "ns/tick", "ns/ghost-tick");
+    for (int n : counts) {
+        GhostSet ghosts;
+        for (int i = 0; i < n; i++) {
+            int c = (int)rng.below(graph.cellCount());
+            int spawn = ghosts.add(i % GHOST_KIND_COUNT, graph.cellRow(c), graph.cellCol(c),
+                i % GHOST_SPRITE_COUNT, 0);
+            ghosts.release(spawn);
+        }
+        long long ticks = moves / n > 0 ? moves / n : 1;
+        int pac = 0;
+        long long sink = 0;
+        auto t0 = chrono::steady_clock::now();
+        for (long long t = 0; t < ticks; t++) {
+            if (t % 8 == 0) pac = (int)rng.below(graph.cellCount());
+            ghosts.move(map, graph.cellRow(pac), graph.cellCol(pac), rng, graph);
+            sink += ghosts.firstAt(graph.cellRow(pac), graph.cellCol(pac));
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        printf("  %6d %10lld %12.1f %14.2f   (checksum %lld)\n",
+            n, ticks, ns / ticks, ns / ticks / n, sink);
+    }
+    return 0;
+}
+
+// Collision at high ghost counts: each row fills the board with `n`
+// released ghosts of every behaviour and lets Pacman random-walk among
+// them, jumping to a new cell every 8 ticks so the chasers do not all pile
+// onto him. Per tick it times GhostSet::move(), which also keeps the
+// occupancy grid current, and the swept collision check both through the
+// grid and by scanning every ghost. The two checks must agree every tick.
+static int runStress(int maxGhosts, uint64_t seed) {
+    const JunctionGraph& graph = JunctionGraph::classic();
+    const int ticks = 2000, repeats = 16;
+    Map map;
+    Rng rng(seed);
+
+    printf("stress: %d ticks per row, collision checks repeated %dx\n", ticks, repeats);
+    printf("  %6s %12s %12s %12s %8s\n", "ghosts", "move ns", "grid ns", "scan ns", "hits");
+    long long mismatches = 0;
+    for (int n = 250;; n *= 2) {
+        if (n > maxGhosts) n = maxGhosts;
+        GhostSet ghosts;
+        ghosts.reserve(GHOST_RANDOM, n);
+        ghosts.reserve(GHOST_BLINKY, n);
+        ghosts.reserve(GHOST_PINKY, n);
+        for (int i = 0; i < n; i++) {
+            int c = (int)rng.below(graph.cellCount());
+            int spawn = ghosts.add(i % GHOST_KIND_COUNT, graph.cellRow(c), graph.cellCol(c),
+                i % GHOST_SPRITE_COUNT, 0);
+            ghosts.release(spawn);
+        }
+
+        int px = PAC_START_X, py = PAC_START_Y;
+        double moveNs = 0, gridNs = 0, scanNs = 0;
+        long long hits = 0;
+        for (int t = 0; t < ticks; t++) {
+            if (t % 8 == 0) {
+                int c = (int)rng.below(graph.cellCount());
+                px = graph.cellRow(c);
+                py = graph.cellCol(c);
+            }
+            int fx = px, fy = py;
+            for (int tries = 0; tries < 4; tries++) {
+                int nx = fx, ny = fy;
+                PathTable::applyDir(nx, ny, DIR_LEFT + (int)rng.below(4));
+                if (graph.idOf(nx, ny) >= 0) { px = nx; py = ny; break; }
+            }
+
+            auto t0 = chrono::steady_clock::now();
+            ghosts.move(map, px, py, rng, graph);
+            auto t1 = chrono::steady_clock::now();
+            int grid = -1, scan = -1;
+            for (int r = 0; r < repeats; r++) grid = ghosts.firstHit(fx, fy, px, py);
+            auto t2 = chrono::steady_clock::now();
+            for (int r = 0; r < repeats; r++) scan = ghosts.scanHit(fx, fy, px, py);
+            auto t3 = chrono::steady_clock::now();
+
+            moveNs += chrono::duration<double, nano>(t1 - t0).count();
+            gridNs += chrono::duration<double, nano>(t2 - t1).count() / repeats;
+            scanNs += chrono::duration<double, nano>(t3 - t2).count() / repeats;
+            hits += grid >= 0;
+            mismatches += grid != scan;
+        }
+        printf("  %6d %12.0f %12.1f %12.1f %8lld\n", n, moveNs / ticks, gridNs / ticks,
+            scanNs / ticks, hits);
+        if (n == maxGhosts) break;
+    }
+    printf("grid and scan disagreed on %lld ticks\n", mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// The batched environment: first each game's first episode against
+// playGame() with the same seed and inputs, then env-steps per second on
+// this one core as the batch grows.
+static int runVecEnv(int maxEnvs, uint64_t seed) {
+    const int checkEnvs = 256, maxFrames = 20000;
+    {
+        VecEnv env(checkEnvs, maxFrames);
+        vector<uint64_t> seeds(checkEnvs);
+        vector<Rng> inputRngs;
+        for (int g = 0; g < checkEnvs; g++) {
+            seeds[g] = seed + g;
+            inputRngs.emplace_back(~seeds[g]);
+        }
+        env.reset(seeds.data());
+
+        // wanderPolicy, from the env's frame counter instead of a Simulation.
+        vector<int> actions(checkEnvs);
+        vector<GameResult> first(checkEnvs);
+        vector<char> finished(checkEnvs, 0);
+        int left = checkEnvs;
+        while (left > 0) {
+            for (int g = 0; g < checkEnvs; g++)
+                actions[g] = env.getFrame(g) % 8 == 0 ? (int)inputRngs[g].below(4) + 1 : DIR_NONE;
+            env.step(actions.data());
+            for (int g = 0; g < checkEnvs; g++)
+                if (env.getDones()[g] && !finished[g]) {
+                    first[g] = env.lastResult(g);
+                    finished[g] = 1;
+                    left--;
+                }
+        }
+
+        Simulation sim;
+        int mismatches = 0;
+        for (int g = 0; g < checkEnvs; g++) {
+            const GameResult& a = first[g];
+            GameResult b = playGame(sim, seeds[g], wanderPolicy, maxFrames);
+            if (a.score != b.score || a.frames != b.frames || a.level != b.level || a.end != b.end
+                || a.killer != b.killer) {
+                if (mismatches++ < 5)
+                    printf("seed %llu: env %d pts %d frames %s, sim %d pts %d frames %s\n",
+                        (unsigned long long)seeds[g], a.score, a.frames, gameEndName(a.end),
+                        b.score, b.frames, gameEndName(b.end));
+            }
+        }
+        printf("vec-env: %d games checked against Simulation, %d differ\n", checkEnvs, mismatches);
+        if (mismatches) return 1;
+    }
+
+    printf("  %6s %14s %12s\n", "envs", "env-steps/s", "ns/env-step");
+    for (int n = 1;; n *= 4) {
+        if (n > maxEnvs) n = maxEnvs;
+        VecEnv env(n);
+        vector<uint64_t> seeds(n);
+        for (int g = 0; g < n; g++) seeds[g] = seed + g;
+        env.reset(seeds.data());
+        vector<int> actions(n, DIR_NONE);
+        Rng inputRng(~seed);
+        long long steps = 4000000 / n + 1;
+
+        auto t0 = chrono::steady_clock::now();
+        for (long long t = 0; t < steps; t++) {
+            for (int g = 0; g < n; g++)
+                actions[g] = (t + g) % 8 == 0 ? (int)inputRng.below(4) + 1 : DIR_NONE;
+            env.step(actions.data());
+        }
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        double envSteps = (double)steps * n;
+        printf("  %6d %14.0f %12.1f\n", n, envSteps / secs, secs * 1e9 / envSteps);
+        if (n == maxEnvs) break;
+    }
+    return 0;
+}
+
+// AutoPlayer over `games` games from `seed` on: how each one ended, then
+// the search's cost per decision against the time one tick has on screen,
+// simulated ticks per second inside the search and the transposition
+// table's hit rate.
+static int runAutoplayBench(int games, uint64_t seed) {
+    const int maxFrames = 20000;
+    AutoPlayer player;
+    Simulation sim;
+    long long wins = 0, totalScore = 0;
+
+    printf("%6s %6s %5s %6s %-8s\n", "game", "score", "level", "frames", "end");
+    for (int g = 0; g < games; g++) {
+        sim.reset(seed + g);
+        while (!sim.isFinished() && sim.getFrameCount() < maxFrames)
+            sim.step(player.choose(sim));
+        const char* end = sim.isWon() ? "won" : sim.isGameOver() ? "caught" : "timeout";
+        printf("%6d %6d %5d %6d %-8s\n", g, sim.getScore(), sim.getLevel(), sim.getFrameCount(), end);
+        wins += sim.isWon();
+        totalScore += sim.getScore();
+    }
+
+    const AutoPlayer::Stats& st = player.getStats();
+    double decisions = st.decisions ? (double)st.decisions : 1;
+    double budgetMs = 1000.0 / FPS;
+    printf("autoplay: %d games, %lld won, mean score %.1f\n", games, wins, (double)totalScore / games);
+    printf("  %llu decisions, mean depth %.2f, %.0f ticks searched per decision\n",
+        (unsigned long long)st.decisions, st.depthSum / decisions, st.nodes / decisions);
+    printf("  %.3f ms mean, %.3f ms max per decision = %.1f%% / %.1f%% of a %.1f ms tick\n",
+        st.seconds * 1000 / decisions, st.maxMs, st.seconds * 1000 / decisions / budgetMs * 100,
+        st.maxMs / budgetMs * 100, budgetMs);
+    printf("  %.2f M simulated ticks/s, table hits %.1f%% of %llu lookups\n",
+        st.seconds > 0 ? st.nodes / st.seconds / 1e6 : 0.0,
+        st.lookups ? 100.0 * st.hits / st.lookups : 0.0, (unsigned long long)st.lookups);
+    return 0;
+}
+
+// A BigWorld input that explores: keeps going along a corridor and picks
+// a new way at random at junctions and dead ends, only turning back when
+// there is nothing else.
+static int exploreInput(const BigWorld& w, Rng& rng) {
+    unsigned exits = w.pacExits();
+    int dir = w.getIntent();
+    bool open = dir != DIR_NONE && (exits & dirBit(dir));
+    if (open && popcount64(exits) <= 2) return DIR_NONE;
+    unsigned back = dir != DIR_NONE ? dirBit(PathTable::opposite(dir)) : 0;
+    if (exits & ~back) exits &= ~back;
+    if (!exits) return DIR_NONE;
+    int k = (int)rng.below(popcount64(exits));
+    for (int d = DIR_LEFT; d <= DIR_UP; d++)
+        if ((exits & dirBit(d)) && k-- == 0) return d;
+    return DIR_NONE;
+}
+
+// BigWorld across maze sizes: ns per tick and per culled frame (the cells
+// and ghosts a frame would draw, without drawing them), how many chunks
+// the run made and what they hold, next to one walk over every cell of
+// the maze, which is what drawing the whole board each frame would cost.
+static int runBigMazeBench(long long ticks, uint64_t seed) {
+    static const int SIZES[] = { 64, 256, 1024, 4096, 16384 };
+    printf("big maze: %lld ticks per size, %dx%d view\n", ticks, SCREEN_W, BOARD_H);
+    printf("  %6s %13s %9s %9s %10s %8s %13s %12s\n", "size", "chunks", "KB", "ns/tick",
+        "ns/frame", "drawn", "ghosts", "walk-all ms");
+    for (int size : SIZES) {
+        BigWorld world(size, seed);
+        Camera cam(SCREEN_W, BOARD_H);
+        Rng inputRng(~seed);
+        const BigMaze& maze = world.getMaze();
+        double tickNs = 0, frameNs = 0;
+        long long drawn = 0;
+
+        for (long long t = 0; t < ticks; t++) {
+            auto t0 = chrono::steady_clock::now();
+            world.step(exploreInput(world, inputRng));
+            auto t1 = chrono::steady_clock::now();
+            cam.follow(world.getPacY() * CELL_SIZE, world.getPacX() * CELL_SIZE,
+                maze.getCols() * CELL_SIZE, maze.getRows() * CELL_SIZE);
+            world.forEachVisibleCell(cam, [&](int, int, char) { drawn++; });
+            world.forEachVisibleGhost(cam, [&](const BigWorld::Ghost&) { drawn++; });
+            auto t2 = chrono::steady_clock::now();
+            tickNs += chrono::duration<double, nano>(t1 - t0).count();
+            frameNs += chrono::duration<double, nano>(t2 - t1).count();
+        }
+
+        auto t0 = chrono::steady_clock::now();
+        long long open = 0;
+        for (int x = 0; x < maze.getRows(); x++)
+            for (int y = 0; y < maze.getCols(); y++) open += !maze.isWall(x, y);
+        double walkMs = msSince(t0);
+
+        char chunks[32], ghosts[32];
+        snprintf(chunks, sizeof(chunks), "%d/%d", maze.madeChunks(), maze.getChunkRows() * maze.getChunkCols());
+        snprintf(ghosts, sizeof(ghosts), "%.1f/%d", world.meanActiveGhosts(), world.ghostCount());
+        printf("  %6d %13s %9.1f %9.1f %10.1f %8.1f %13s %12.3f\n", size, chunks, maze.bytes() / 1024.0,
+            tickNs / ticks, frameNs / ticks, (double)drawn / ticks, ghosts, walkMs);
+        if (open == 0) printf("  (no open cells made)\n");
+    }
+    printf("  ghosts: mean simulated per tick / made so far\n");
+    return 0;
+}
+
+// A keyboard player for runInputBench: where Pacman is to turn next, and
+// when the key for it goes down.
+struct PlannedTurn {
+    int dir = DIR_NONE;
+    long long tick = -1;        // the tick that should move Pacman `dir`
+    double pressAt = 0;
+    bool pressed = false;
+};
+
+// Follows Pacman's way from where he stands to the first junction or
+// corner at which a random choice turns him, and plans that turn from tick
+// `k`: the key goes down up to 400 ms before the tick that should use it,
+// or up to 100 ms after.
+// No turn if he has nowhere to go.
+static PlannedTurn planTurn(const Simulation& sim, long long k, Rng& rng) {
+    const Map& map = sim.getMap();
+    const Pacman& pac = sim.getPacman();
+    int x = pac.getGridX(), y = pac.getGridY(), dir = pac.getIntent();
+    PlannedTurn t;
+    for (int s = 0; s < MAP_ROWS * MAP_COLS; s++) {
+        int back = dir != DIR_NONE ? PathTable::opposite(dir) : DIR_NONE;
+        int options[4], n = 0;
+        for (int d = DIR_LEFT; d <= DIR_UP; d++) {
+            int nx = x, ny = y;
+            if (d != back && Pacman::moveRule(map, nx, ny, d) != DIR_NONE) options[n++] = d;
+        }
+        if (n == 0) {
+            int nx = x, ny = y;
+            if (back == DIR_NONE || Pacman::moveRule(map, nx, ny, back) == DIR_NONE) return t;
+            options[n++] = back;
+        }
+        // Along a corridor the only choice is straight on.
+        int pick = options[rng.below(n)];
+        if (pick != dir) {
+            double lead = -0.1 + 0.5 * rng.below(1000) / 1000.0;    // seconds early, < 0 late
+            t.dir = pick;
+            t.tick = k + s;
+            t.pressAt = max((double)k / FPS, (double)(k + s) / FPS - lead);
+            return t;
+        }
+        Pacman::moveRule(map, x, y, dir);
+    }
+    return t;
+}
+
+// Keyboard turns through InputQueue, with the old single pending input
+// (window 0) next to buffered ones. A scripted player presses each turn
+// somewhere from 400 ms early to 100 ms late for the junction it is meant
+// for, on the ticks' own clock; the report is how long presses took to
+// move Pacman, how many never did, and how many turns came on the tick
+// the player aimed at.
+static int runInputBench(int presses, uint64_t seed) {
+    static const double WINDOWS[] = { 0, 0.15, DEFAULT_TURN_BUFFER };
+    printf("input: %d presses per window, %.1f ms ticks, presses 400 ms early to 100 ms late\n",
+        presses, 1000.0 / FPS);
+    for (double window : WINDOWS) {
+        Simulation sim(seed);
+        InputQueue turns(window);
+        TurnLatency latency;
+        Rng player(~seed);
+        PlannedTurn plan;
+        long long k = 0, moves = 0, onTime = 0;
+        int made = 0, games = 1;
+
+        while (made < presses) {
+            double now = (double)k / FPS;
+            if (plan.dir == DIR_NONE) plan = planTurn(sim, k, player);
+            if (plan.dir != DIR_NONE && !plan.pressed && plan.pressAt <= now) {
+                turns.push(plan.dir, plan.pressAt);
+                latency.pressed(plan.dir, plan.pressAt);
+                plan.pressed = true;
+                made++;
+            }
+
+            const Pacman& pac = sim.getPacman();
+            int fromX = pac.getGridX(), fromY = pac.getGridY();
+            TickResult r = sim.step(turns.take(sim, now));
+            bool moved = pac.getGridX() != fromX || pac.getGridY() != fromY;
+            latency.ticked(moved ? pac.getIntent() : DIR_NONE, now);
+            moves += moved;
+            if (k == plan.tick && moved && pac.getIntent() == plan.dir) onTime++;
+
+            // Done with this turn once Pacman took it or went past where
+            // it was meant for; a death or a new level starts over.
+            if (r.lostLife || r.levelUp || (plan.pressed && (pac.getIntent() == plan.dir || k >= plan.tick)))
+                plan = PlannedTurn();
+            // A game he can no longer move in is over for the player too.
+            if (sim.isFinished() || (plan.dir == DIR_NONE && !moved && planTurn(sim, k, player).dir == DIR_NONE)) {
+                sim.reset(seed + games++);
+                turns.clear();
+                plan = PlannedTurn();
+            }
+            k++;
+        }
+
+        char label[48];
+        snprintf(label, sizeof(label), "  buffer %3.0f ms", window * 1000);
+        latency.print(stdout, label);
+        printf("  %16s %lld presses dropped, %.1f%% of turns on the aimed tick, Pacman moving %.1f%% of %lld ticks\n",
+            "", turns.getDropped(), 100.0 * onTime / made, 100.0 * moves / k, k);
+    }
+    return 0;
+}
+
+// Cost of taking and restoring a SimSnapshot while games play, and a
+// check that rewinding and stepping again with the same inputs lands on
+// exactly the state the game had reached.
+static int runSnapshotBench(long long ticks, uint64_t seed) {
+    const int WINDOW = 64;
+    Simulation sim(seed);
+    SnapshotRing ring(4096);
+    Rng inputRng(~seed), pick(seed);
+    int inputs[WINDOW];
+    double pushNs = 0, restoreNs = 0;
+    long long restores = 0, mismatches = 0, game = 0;
+
+    auto sameState = [](const Simulation& a, const SimSnapshot& b) {
+        SimSnapshot s;
+        a.save(s);
+        bool same = s.rngState == b.rngState && s.frameCount == b.frameCount
+            && s.score == b.score && s.bola == b.bola && s.currentLevel == b.currentLevel
+            && s.pac.gridX == b.pac.gridX && s.pac.gridY == b.pac.gridY
+            && s.pac.intent == b.pac.intent && s.ghostCount == b.ghostCount
+            && s.deathFrame == b.deathFrame && s.gameover == b.gameover;
+        for (int i = 0; same && i < s.ghostCount; i++)
+            same = s.ghosts[i].x == b.ghosts[i].x && s.ghosts[i].y == b.ghosts[i].y
+            && s.ghosts[i].lastDir == b.ghosts[i].lastDir;
+        for (int i = 0; same && i < MAP_ROWS; i++)
+            for (int j = 0; j < MAP_COLS; j++) same &= s.map.get(i, j) == b.map.get(i, j);
+        return same;
+        };
+
+    for (long long t = 0; t < ticks;) {
+        if (sim.isFinished()) {
+            sim.reset(seed + ++game);
+            ring.clear();
+        }
+        auto t0 = chrono::steady_clock::now();
+        ring.push(sim);
+        pushNs += chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        int slot = sim.getFrameCount() % WINDOW;
+        inputs[slot] = wanderPolicy(sim, inputRng);
+        sim.step(inputs[slot]);
+        t++;
+
+        // Every 8 ticks: rewind up to WINDOW ticks, step forward again with
+        // the same inputs and compare.
+        if (t % 8) continue;
+        SimSnapshot now;
+        sim.save(now);
+        int back = (int)pick.below(ring.size() < WINDOW ? ring.size() : WINDOW);
+        t0 = chrono::steady_clock::now();
+        ring.rewind(sim, back);
+        restoreNs += chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+        restores++;
+        for (int k = 0; k <= back; k++) {
+            ring.push(sim);
+            sim.step(inputs[sim.getFrameCount() % WINDOW]);
+        }
+        mismatches += !sameState(sim, now);
+    }
+
+    printf("snapshot: %zu bytes, ring of %d is %zu KB\n", sizeof(SimSnapshot), ring.capacity(),
+        sizeof(SimSnapshot) * ring.capacity() / 1024);
+    printf("push %.1f ns, restore %.1f ns (%lld restores), %lld replays diverged\n",
+        pushNs / ticks, restoreNs / restores, restores, mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Re-simulates input logs with no display, as fast as the simulation
+// runs, and checks each one ends on the recorded frame, score, level and
+// death frame.
+static int runReplays(const vector<const char*>& paths) {
+    Simulation sim;
+    InputLog log;
+    int failed = 0;
+    long long ticks = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (const char* path : paths) {
+        string error;
+        if (!log.load(path, error)) {
+            printf("%s: %s\n", path, error.c_str());
+            failed++;
+            continue;
+        }
+        GameOutcome want = log.getOutcome(), got = replayLog(sim, log);
+        ticks += got.frames;
+        if (got != want) {
+            failed++;
+            printf("%s: DIVERGES: frames %d/%d, score %d/%d, level %d/%d, death frame %d/%d\n",
+                path, got.frames, want.frames, got.score, want.score, got.level, want.level,
+                got.deathFrame, want.deathFrame);
+        }
+        else if (paths.size() <= 20) {
+            printf("%s: ok: seed %llu, %d frames, score %d, level %d, death frame %d\n",
+                path, (unsigned long long)log.getSeed(), got.frames, got.score, got.level,
+                got.deathFrame);
+        }
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    printf("replayed %zu logs, %lld ticks in %.3f s (%.0f ticks/s), %d failed\n",
+        paths.size(), ticks, secs, ticks / secs, failed);
+    return failed == 0 ? 0 : 1;
+}
+
+// Writes `games` bot-played games to dir/<seed>.paclog as a regression
+// corpus for --replay. Odd games are played by the dot eater, so the
+// corpus reaches later levels and extra lives too.
+static int runRecordCorpus(const char* dir, int games, uint64_t seed) {
+    Simulation sim;
+    InputLog log;
+    long long bytes = 0, changes = 0, frames = 0;
+    for (int g = 0; g < games; g++) {
+        recordGame(sim, log, seed + g, g & 1 ? dotPolicy : wanderPolicy, 100000);
+        string path = string(dir) + "/" + to_string(seed + g) + ".paclog";
+        if (!log.save(path.c_str())) {
+            cerr << "ERROR: cannot write " << path << "\n";
+            return 1;
+        }
+        bytes += (long long)log.getBytes();
+        changes += log.getChanges();
+        frames += log.getOutcome().frames;
+    }
+    printf("recorded %d games to %s: %lld frames, %lld turns in %lld bytes of input"
+        " (%.2f bytes per turn)\n", games, dir, frames, changes, bytes,
+        changes ? (double)bytes / changes : 0.0);
+    return 0;
+}
+
+// Loads and checks a maze file, compiles it into a junction graph and
+// walks every pair of cells both through the graph and through PathTable's
+// full next-hop table; the two must agree on every path length.
+static int runMapInfo(const char* path) {
+    static char rows[MAP_ROWS][MAP_COLS];
+    string error;
+    if (!loadMapFile(path, rows, error)) {
+        fprintf(stderr, "%s: %s\n", path, error.c_str());
+        return 1;
+    }
+    MapLayout layout(rows);
+    Map map(layout);
+    // Pacman's start if the maze has it, else its first open cell.
+    int sx = PAC_START_X, sy = PAC_START_Y;
+    bool inside = sx < layout.height && sy < layout.width;
+    for (int c = 0; c < MAP_CELLS && (!inside || map.isWall(sx, sy)); c++) {
+        sx = c / MAP_COLS;
+        sy = c % MAP_COLS;
+        inside = sx < layout.height && sy < layout.width;
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    JunctionGraph graph(map, sx, sy);
+    auto t1 = chrono::steady_clock::now();
+    PathTable table(map, sx, sy);
+    auto t2 = chrono::steady_clock::now();
+
+    printf("%s: %d x %d, %d reachable cells\n", path, layout.height, layout.width, graph.cellCount());
+    printf("tunnel rows:");
+    for (int i = 0; i < MAP_ROWS; i++)
+        if (layout.tunnels >> i & 1) printf(" %d", i);
+    printf("%s\n", layout.tunnels ? "" : " none");
+    printf("junction graph: %d nodes, %d corridors, %zu bytes, built in %.2f ms\n",
+        graph.nodeCount(), graph.corridorCount(), graph.bytes(),
+        chrono::duration<double, milli>(t1 - t0).count());
+    printf("next-hop table: %zu bytes, built in %.2f ms\n", table.bytes(),
+        chrono::duration<double, milli>(t2 - t1).count());
+
+    long long pairs = 0, mismatches = 0;
+    int n = graph.cellCount();
+    for (int from = 0; from < n; from++)
+        for (int to = 0; to < n; to++) {
+            int fx = graph.cellRow(from), fy = graph.cellCol(from);
+            int tx = graph.cellRow(to), ty = graph.cellCol(to);
+            int want = 0;
+            for (int x = fx, y = fy; table.idOf(x, y) != table.idOf(tx, ty) && want <= n; want++)
+                PathTable::applyDir(x, y, table.nextDir(x, y, tx, ty));
+            int got = 0;
+            for (int x = fx, y = fy; graph.idOf(x, y) != to && got <= n; got++)
+                PathTable::applyDir(x, y, graph.nextDir(x, y, tx, ty));
+            pairs++;
+            if (got != want || graph.distance(fx, fy, tx, ty) != want) {
+                if (mismatches++ < 5)
+                    printf("  (%d,%d) -> (%d,%d): graph %d, table %d\n", fx, fy, tx, ty, got, want);
+            }
+        }
+    printf("paths checked: %lld, mismatched: %lld\n", pairs, mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// --profile: on the way out of main, whatever the mode, prints the
+// whole-run phase table and writes <prefix>.json (Chrome trace, load it in
+// chrome://tracing or Perfetto) and <prefix>.csv.
+struct ProfileExport {
+    const char* prefix = nullptr;
+    ~ProfileExport() {
+        if (!prefix) return;
+        string json = string(prefix) + ".json", csv = string(prefix) + ".csv";
+        Profiler::printSummary(stdout);
+        if (!Profiler::writeChromeTrace(json.c_str())) cerr << "ERROR: cannot write " << json << "\n";
+        if (!Profiler::writeCsv(csv.c_str())) cerr << "ERROR: cannot write " << csv << "\n";
+        printf("profile written to %s and %s\n", json.c_str(), csv.c_str());
+    }
+};
+
+int main(int argc, char** argv) {
+    GameOptions opts;
+    uint64_t seed = (uint64_t)time(nullptr);
+    long long benchTicks = 0;
+    long long ghostDecisions = 0;
+    long long ghostMoves = 0;
+    long long snapshotTicks = 0;
+    int stressGhosts = 0;
+    int vecEnvs = 0;
+    int autoplayGames = 0;
+    long long bigMazeTicks = 0;
+    int inputTurns = 0;
+    int bigMazeSize = 0;
+    int batchGames = 0;
+    int threads = (int)thread::hardware_concurrency();
+    const char* csvPath = nullptr;
+    const char* packPath = nullptr;
+    const char* mapInfoPath = nullptr;
+    vector<const char*> replayPaths;
+    bool watch = false;
+    const char* corpusDir = nullptr;
+    int corpusGames = 0;
+    ProfileExport profile;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--bench") == 0) {
+            benchTicks = 10000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                benchTicks = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-ghosts") == 0) {
+            ghostDecisions = 20000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                ghostDecisions = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-ghost-scaling") == 0) {
+            ghostMoves = 20000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                ghostMoves = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-snapshots") == 0) {
+            snapshotTicks = 2000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                snapshotTicks = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stress") == 0) {
+            stressGhosts = 8000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                stressGhosts = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--vec-env") == 0) {
+            vecEnvs = 4096;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                vecEnvs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--autoplay-bench") == 0) {
+            autoplayGames = 20;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                autoplayGames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bench-big-maze") == 0) {
+            bigMazeTicks = 200000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                bigMazeTicks = atoll(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--big-maze") == 0) {
+            bigMazeSize = 1024;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                bigMazeSize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--turn-buffer") == 0 && i + 1 < argc) {
+            opts.turnBuffer = atof(argv[++i]) / 1000;
+        }
+        else if (strcmp(argv[i], "--turn-report") == 0) {
+            opts.turnReport = true;
+        }
+        else if (strcmp(argv[i], "--bench-input") == 0) {
+            inputTurns = 20000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                inputTurns = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--autoplay") == 0) {
+            opts.autoplay = true;
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchGames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-atlas") == 0) {
+            opts.atlas = false;
+        }
+        else if (strcmp(argv[i], "--draw-stats") == 0) {
+            opts.drawStats = true;
+        }
+        else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            opts.tickRate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--render-rate") == 0 && i + 1 < argc) {
+            opts.renderRate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pack-assets") == 0) {
+            packPath = ASSET_PACK;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                packPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-pack") == 0) {
+            opts.usePack = false;
+        }
+        else if (strcmp(argv[i], "--cold") == 0) {
+            opts.cold = true;
+        }
+        else if (strcmp(argv[i], "--startup-report") == 0) {
+            opts.startupReport = true;
+        }
+        else if (strcmp(argv[i], "--load-threads") == 0 && i + 1 < argc) {
+            opts.loadThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            opts.recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-record") == 0) {
+            opts.recordPath = nullptr;
+        }
+        else if (strcmp(argv[i], "--replay") == 0) {
+            while (i + 1 < argc && argv[i + 1][0] != '-')
+                replayPaths.push_back(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        }
+        else if (strcmp(argv[i], "--record-corpus") == 0 && i + 1 < argc) {
+            corpusDir = argv[++i];
+            corpusGames = 200;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                corpusGames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profile.prefix = "profile";
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                profile.prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--map-info") == 0) {
+            mapInfoPath = "assets/maps/classic/matriz.txt";
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                mapInfoPath = argv[++i];
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (profile.prefix) Profiler::enable(true);
+    if (opts.tickRate <= 0) opts.tickRate = FPS;
+
+    if (benchTicks > 0)
+        return runHeadlessBench(benchTicks, seed);
+    if (ghostDecisions > 0)
+        return runGhostBench(ghostDecisions, seed);
+    if (ghostMoves > 0)
+        return runGhostScaling(ghostMoves, seed);
+    if (snapshotTicks > 0)
+        return runSnapshotBench(snapshotTicks, seed);
+    if (stressGhosts > 0)
+        return runStress(stressGhosts, seed);
+    if (vecEnvs > 0)
+        return runVecEnv(vecEnvs, seed);
+    if (autoplayGames > 0)
+        return runAutoplayBench(autoplayGames, seed);
+    if (bigMazeTicks > 0)
+        return runBigMazeBench(bigMazeTicks, seed);
+    if (inputTurns > 0)
+        return runInputBench(inputTurns, seed);
+    if (batchGames > 0)
+        return runBatch(batchGames, threads, seed, csvPath);
+    if (packPath)
+        return Game(opts).packAssets(packPath) ? 0 : 1;
+    if (mapInfoPath)
+        return runMapInfo(mapInfoPath);
+    if (corpusDir)
+        return runRecordCorpus(corpusDir, corpusGames, seed);
+    if (!replayPaths.empty() && !watch)
+        return runReplays(replayPaths);
+
+    // --replay <log> --watch: the recorded game on screen at --tick-rate.
+    InputLog watched;
+    if (!replayPaths.empty()) {
+        string error;
+        if (!watched.load(replayPaths[0], error)) {
+            cerr << "ERROR: " << replayPaths[0] << ": " << error << "\n";
+            return -1;
+        }
+        seed = watched.getSeed();
+        opts.replay = &watched;
+        opts.recordPath = nullptr;
+    }
+
+    // Printed so any session can be replayed with --seed.
+    cout << "seed: " << seed << "\n";
+    if (bigMazeSize > 0) {
+        BigMazeGame big(bigMazeSize, seed);
+        bool ok = big.init(opts.tickRate);
+        if (ok) big.run();
+        big.cleanup();
+        return ok ? 0 : -1;
+    }
+    opts.seed = seed;
+    Game game(opts);
     if (!game.init()) {
         cerr << "Initialization failed\n";
         return -1;
     }
     game.run();
+    game.reportTurns();
+    bool logged = game.finishLog();
     game.cleanup();
-    return 0;
+    return logged ? 0 : 1;
 }